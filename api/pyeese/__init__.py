@@ -11,19 +11,40 @@ Typical usage example:
     from mypackage import connect
 
     with connect("/dev/ttyACM0") as conn:
-        conn.send_nop()
-        conn.iterate()
+        conn.wait(conn.send_nop())
 
 Modules:
     cobs: Implements COBS encoding and decoding functions.
     connection: Handles serial communication, packet parsing, and message
         dispatch.
+    firmware: Streams a firmware image to the device over the serial link.
+    profile: Symbolises the device's PC-sampling profiler into a flat
+        profile.
+    daemon: Owns the serial ports and publishes measurements to shared
+        memory for many local readers.
+    shm: Shared-memory sample ring written by the daemon and read by
+        consumers.
 """
 
 
 __all__ = [
     "Connection",
+    "Event",
+    "EventType",
+    "LinkStats",
+    "NackError",
+    "NackReason",
+    "WindowFullError",
     "connect",
 ]
 
-from .connection import Connection, connect
+from .connection import (
+    Connection,
+    Event,
+    EventType,
+    LinkStats,
+    NackError,
+    NackReason,
+    WindowFullError,
+    connect,
+)
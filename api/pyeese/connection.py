@@ -10,11 +10,28 @@ This module provides:
 
 Protocol details:
     Each packet is structured as:
-        [protocol_version: uint32]
+        [protocol_version: uint8]
         [type: uint8]
+        [flags: uint8]
+        [seq: uint16]
+        [request_id: uint16]
         [payload: bytes]
         [CRC32: uint32]
-    Packets are COBS-encoded for transmission.
+    All fields are little-endian. CRC32 is `device_crc32()` of everything
+    before it, so the CRC32 of a whole packet is zero. Packets are
+    COBS-encoded for transmission.
+
+    `seq` counts the packets sent in each direction, gaps in the device's
+    are lost packets. The device sets `FLAG_BOOT` on its first packets
+    after a reset, telling a restart of `seq` from a wrap. Commands sent
+    with a non-zero `request_id` are answered with an ACK or NACK carrying
+    the same `request_id`, so several can be in flight at once.
+
+    The device changes clock speed when a firmware update starts, and when
+    it finishes or has been idle for 10 seconds. Its serial port is off for
+    up to ~10 ms while that happens, so anything sent meanwhile is lost.
+    Those commands are not NACKed. They time out after `REQUEST_TIMEOUT`
+    and have to be resent.
 
 Intended usage:
     with connect("/dev/ttyACM0") as conn:
@@ -24,11 +41,16 @@ Requires:
     - `pyserial` for serial communication
     - `cobs` module for encoding/decoding packets
 """
+import asyncio
 import binascii
+import collections
+import concurrent.futures
+import dataclasses
 import enum
 import logging
 import select
 import struct
+import time
 
 import serial
 
@@ -41,12 +63,161 @@ class PacketInType(enum.Enum):
     MEASUREMENTS = 2
     HEALTH = 3
     EVENT = 4
+    FW_STATUS = 5
+    PROFILE = 6
+    SAMPLE = 7
+    ACK = 8
+    NACK = 9
 
 
 class PacketOutType(enum.Enum):
     """Enumeration of packet types sent to the device."""
     NOP = 1
     RESET = 2
+    FW_BEGIN = 3
+    FW_BLOCK = 4
+    FW_END = 5
+    TRIGGER = 6
+
+
+class NackReason(enum.Enum):
+    """Enumeration of the reasons the device refuses a command."""
+    UNKNOWN_TYPE = 1
+    BAD_LENGTH = 2
+    BUSY = 3
+    SENSOR = 4
+
+
+class NackError(Exception):
+    """
+    Raised for a command the device refused.
+
+    Attributes:
+        reason: The `NackReason`, or the raw value if unknown to this
+            version.
+    """
+    def __init__(self, reason: NackReason | int):
+        name = reason.name if isinstance(reason, NackReason) else reason
+        super().__init__(f"Command refused by device: {name}")
+        self.reason = reason
+
+
+class WindowFullError(Exception):
+    """
+    Raised for a command sent while `window` commands are already in
+    flight. See `Connection.wait_room()`.
+    """
+
+
+class EventType(enum.Enum):
+    """Enumeration of event types reported by the device."""
+    QUEUE_OVERFLOW = 1
+    UART_ERROR = 2
+    UART_RX_OVERFLOW = 3
+    ITF_BAD_PACKET = 4
+    SENSOR_ERROR = 5
+    ISR_CYCLES = 6
+
+
+@dataclasses.dataclass(frozen=True)
+class Event:
+    """
+    An event reported by the device.
+
+    Attributes:
+        type: The `EventType`, or the raw value if unknown to this version.
+        timestamp_ms: Device time since boot of the latest occurrence.
+        count: Number of identical occurrences coalesced into this event.
+        arg: Type specific argument.
+    """
+    type: EventType | int
+    timestamp_ms: int
+    count: int
+    arg: int
+
+
+@dataclasses.dataclass(frozen=True)
+class FwStatus:
+    """
+    Firmware update status reported by the device after every update
+    command.
+
+    Attributes:
+        state: Device update state (see `pyeese.firmware.FwState`).
+        result: Result of the command (see `pyeese.firmware.FwResult`).
+        offset: Next image offset the device expects.
+        size: Size of the image being received.
+    """
+    state: int
+    result: int
+    offset: int
+    size: int
+
+
+@dataclasses.dataclass
+class Profile:
+    """
+    A snapshot of the device's PC-sampling profiler histogram.
+
+    Attributes:
+        snapshot: Snapshot sequence number.
+        base: Address of the first bucket.
+        shift: Each bucket covers `1 << shift` bytes.
+        counts: Samples per bucket index, empty buckets are left out.
+        other: Samples outside the firmware (e.g. RAM functions).
+    """
+    snapshot: int
+    base: int
+    shift: int
+    counts: dict[int, int] = dataclasses.field(default_factory=dict)
+    other: int = 0
+
+
+@dataclasses.dataclass
+class LinkStats:
+    """
+    Statistics of the packets received from the device, from gaps in their
+    sequence numbers.
+
+    Attributes:
+        received: Packets received intact.
+        lost: Packets the device sent that were never received (including
+            those dropped for a bad CRC).
+        crc_errors: Packets dropped for a bad CRC.
+        restarts: Times the sequence started again, i.e. the device reset.
+    """
+    received: int = 0
+    lost: int = 0
+    crc_errors: int = 0
+    restarts: int = 0
+
+    @property
+    def loss_ratio(self) -> float:
+        """float: Fraction of the device's packets that were lost."""
+        total = self.received + self.lost
+        return self.lost / total if total else 0.
+
+
+@dataclasses.dataclass
+class _Request:
+    future: concurrent.futures.Future
+    deadline: float
+
+
+def device_crc32(data: bytes, crc: int = 0xFFFFFFFF) -> int:
+    """
+    Calculate a CRC32 the same way the device does.
+
+    The device's CRC32 has no final XOR, unlike `binascii.crc32`.
+
+    Args:
+        data: Bytes to calculate the CRC over.
+        crc: Start value, or a previous result to continue from.
+
+    Returns:
+        int: The CRC32.
+    """
+    return binascii.crc32(data, crc ^ 0xFFFFFFFF) ^ 0xFFFFFFFF
 
 
 class Connection:
@@ -57,16 +228,48 @@ class Connection:
     Packets follow the structure:
         [protocol_version: uint8]
         [type: uint8]
+        [flags: uint8]
+        [seq: uint16]
+        [request_id: uint16]
         [payload: bytes]
         [CRC32: uint32]
 
     The packet is then COBS-encoded before transmission.
+
+    Commands return a `concurrent.futures.Future` that completes when the
+    device acks it, or fails with `NackError` or `TimeoutError`. Up to
+    `window` commands are kept in flight, sending another raises
+    `WindowFullError` rather than blocking, see `wait_room()`. Futures only
+    progress while the connection is iterated, see `wait()` and
+    `wait_all()`.
+
+    Set `on_measurements` to a callable taking (temperature,
+    relative_humidity) to be told of every new measurement.
     """
-    HEADER_STRUCT = "<BB"
-    PROTOCOL_VERSION = 1
+    HEADER_STRUCT = "<BBBHH"
+    FLAG_BOOT = 0x01
+    PROTOCOL_VERSION = 2
+    NO_REQUEST = 0
+    REQUEST_WINDOW = 16
+    REQUEST_TIMEOUT = 1.0
+    NACK_STRUCT = "<B"
     MEASUREMENTS_STRUCT = "<ii"
-
-    def __init__(self, tty: str = "/dev/ttyACM0"):
+    EVENT_STRUCT = "<IHHI"
+    EVENTS_MAX_QUEUED = 256
+    FW_BEGIN_STRUCT = "<II"
+    FW_BLOCK_STRUCT = "<II"
+    FW_STATUS_STRUCT = "<BBII"
+    FW_BLOCK_MAX = 64
+    PROFILE_STRUCT = "<IBBH"
+    PROFILE_ENTRY_STRUCT = "<HH"
+    PROFILE_BUCKET_OTHER = 0xFFFF
+
+    def __init__(
+        self,
+        tty: str = "/dev/ttyACM0",
+        window: int = REQUEST_WINDOW,
+        timeout: float = REQUEST_TIMEOUT,
+    ):
         self._serial = serial.Serial(
             port=tty,
             baudrate=115200,
@@ -84,6 +287,24 @@ class Connection:
         self._leftovers = b""
         self._temperature = None
         self._relative_humidity = None
+        self._events = collections.deque(maxlen=Connection.EVENTS_MAX_QUEUED)
+        self._fw_statuses = collections.deque()
+        self._profile = None
+        self._profiles = collections.deque()
+        self._window = window
+        self._timeout = timeout
+        self._tx_seq = 0
+        self._request_id = Connection.NO_REQUEST
+        self._requests = {}
+        self._rx_seq = None
+        self._rx_booting = False
+        # Request ID of the packet being handled
+        self._rx_request_id = Connection.NO_REQUEST
+        self._stats = LinkStats()
+        self._samples = {}
+        self._sample_futures = {}
+        self._async_readers = 0
+        self.on_measurements = None
 
     def __enter__(self):
         return self
@@ -96,30 +317,272 @@ class Connection:
 
     def close(self) -> None:
         """Close the serial connection and clear any buffered data."""
-        self._serial.flush()
         if self._serial is not None:
+            self._serial.flush()
             self._leftovers = b""
             self._serial.close()
             self._serial = None
 
-    def _send_message(self, type_: PacketOutType, payload: bytes) -> None:
+    def fileno(self) -> int:
+        """
+        File descriptor of the serial port, so a `Connection` can be used
+        with `select`.
+        """
+        return self._serial.fileno()
+
+    def _send_message(
+        self,
+        type_: PacketOutType,
+        payload: bytes,
+        request_id: int = NO_REQUEST,
+    ) -> None:
         header = struct.pack(
             Connection.HEADER_STRUCT, Connection.PROTOCOL_VERSION, type_.value,
+            0, self._tx_seq, request_id,
         )
-        crc = binascii.crc32(header + payload)
-        packet = header + payload + crc.to_bytes(4)
+        self._tx_seq = (self._tx_seq + 1) & 0xFFFF
+        # Appended as the device stores it, so its CRC over the whole
+        # packet comes out as zero
+        crc = device_crc32(header + payload)
+        packet = header + payload + crc.to_bytes(4, "little")
         enc = encode(packet)
         enc += (0).to_bytes(1)
         self._serial.write(enc)
 
-    def send_nop(self) -> None:
-        """Send a no-operation packet to the device."""
-        self._send_message(PacketOutType.NOP, b"")
+    def _request(
+        self,
+        type_: PacketOutType,
+        payload: bytes,
+        timeout: float | None = None,
+    ) -> tuple[int, concurrent.futures.Future]:
+        # Never blocks, callers may be on an event loop
+        if self._window_full():
+            raise WindowFullError(
+                f"{len(self._requests)} commands already in flight"
+            )
+        # Zero is reserved for packets that want no answer
+        self._request_id = self._request_id % 0xFFFF + 1
+        future = concurrent.futures.Future()
+        if timeout is None:
+            timeout = self._timeout
+        self._requests[self._request_id] = _Request(
+            future, time.monotonic() + timeout,
+        )
+        self._send_message(type_, payload, self._request_id)
+        return self._request_id, future
+
+    def _expire_requests(self) -> None:
+        now = time.monotonic()
+        for request_id, request in list(self._requests.items()):
+            if request.deadline <= now:
+                del self._requests[request_id]
+                if not request.future.done():
+                    request.future.set_exception(
+                        TimeoutError(f"No answer to request {request_id}")
+                    )
+
+    def _window_full(self) -> bool:
+        self._expire_requests()
+        return len(self._requests) >= self._window
+
+    @property
+    def in_flight(self) -> int:
+        """int: Number of commands sent but not yet answered."""
+        return len(self._requests)
+
+    def wait(self, future: concurrent.futures.Future):
+        """
+        Handle incoming packets until a command is answered.
+
+        Args:
+            future: As returned by a command.
+
+        Returns:
+            The command's result.
+
+        Raises:
+            NackError: If the device refused the command.
+            TimeoutError: If the device did not answer in time.
+        """
+        while not future.done():
+            self.iterate(0.05)
+        return future.result()
+
+    def wait_room(self) -> None:
+        """
+        Handle incoming packets until another command can be sent without
+        raising `WindowFullError`.
+        """
+        while self._window_full():
+            self.iterate(0.05)
+
+    def wait_all(self) -> None:
+        """
+        Handle incoming packets until every command in flight is answered
+        or timed out.
+        """
+        while self._requests:
+            self.iterate(0.05)
+
+    def send_nop(self) -> concurrent.futures.Future:
+        """
+        Send a no-operation packet to the device.
+
+        Returns:
+            Future completed when the device acks it.
+        """
+        return self._request(PacketOutType.NOP, b"")[1]
 
     def send_reset(self) -> None:
-        """Send a reset packet to the device."""
+        """
+        Send a reset packet to the device.
+
+        The device resets straight away so this is not acked.
+        """
         self._send_message(PacketOutType.RESET, b"")
 
+    def send_fw_begin(self, size: int, crc: int) -> concurrent.futures.Future:
+        """
+        Start (or resume) a firmware update.
+
+        Args:
+            size: Size of the image in bytes.
+            crc: `device_crc32()` of the whole image.
+
+        Returns:
+            Future completed when the device acks it, the outcome is
+            reported by FW_STATUS.
+        """
+        payload = struct.pack(Connection.FW_BEGIN_STRUCT, size, crc)
+        return self._request(
+            PacketOutType.FW_BEGIN, payload, max(self._timeout, 5.0),
+        )[1]
+
+    def send_fw_block(
+        self,
+        offset: int,
+        data: bytes,
+    ) -> concurrent.futures.Future:
+        """
+        Send a block of the firmware image.
+
+        Args:
+            offset: Offset of the block within the image.
+            data: Up to `FW_BLOCK_MAX` bytes of the image.
+
+        Returns:
+            Future completed when the device acks it, the outcome is
+            reported by FW_STATUS.
+        """
+        payload = struct.pack(
+            Connection.FW_BLOCK_STRUCT, offset, device_crc32(data),
+        )
+        return self._request(PacketOutType.FW_BLOCK, payload + data)[1]
+
+    def send_fw_end(self) -> concurrent.futures.Future:
+        """
+        Finish a firmware update, the device checks the whole image.
+
+        Returns:
+            Future completed when the device acks it, the outcome is
+            reported by FW_STATUS.
+        """
+        return self._request(PacketOutType.FW_END, b"")[1]
+
+    def send_trigger(self) -> concurrent.futures.Future:
+        """
+        Ask the device for a fresh measurement right away, answered by a
+        SAMPLE packet. See `read_now()` to get the sample.
+
+        Returns:
+            Future completed when the device acks it.
+        """
+        return self._request(PacketOutType.TRIGGER, b"")[1]
+
+    def read_now(self, timeout: float = 1.0) -> tuple[float, float]:
+        """
+        Trigger a measurement and wait for it, rather than using the latest
+        periodic one which may be up to a measurement cycle old.
+
+        Other packets received meanwhile are handled as by `iterate()`.
+
+        Args:
+            timeout: Seconds to wait for the sample.
+
+        Returns:
+            The (temperature, relative_humidity) measured after the request.
+
+        Raises:
+            NackError: If the device refused the trigger, or the sensor
+                failed to measure.
+            TimeoutError: If no sample was received in time.
+        """
+        deadline = time.monotonic() + timeout
+        self.wait_room()
+        request_id, _ = self._request(PacketOutType.TRIGGER, b"", timeout)
+        self._samples[request_id] = None
+        try:
+            while self._samples[request_id] is None:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    raise TimeoutError(f"No sample for request {request_id}")
+                self.iterate(remaining)
+            sample = self._samples[request_id]
+            if isinstance(sample, NackError):
+                raise sample
+            return sample
+        finally:
+            del self._samples[request_id]
+
+    async def read_now_async(
+        self,
+        timeout: float = 1.0,
+    ) -> tuple[float, float]:
+        """
+        Asynchronous `read_now()`, reading the serial port from the running
+        event loop while waiting.
+
+        Args:
+            timeout: Seconds to wait for the sample.
+
+        Returns:
+            The (temperature, relative_humidity) measured after the request.
+
+        Raises:
+            NackError: If the device refused the trigger, or the sensor
+                failed to measure.
+            TimeoutError: If no sample was received in time.
+        """
+        loop = asyncio.get_running_loop()
+        future = loop.create_future()
+        fd = self.fileno()
+        deadline = loop.time() + timeout
+        request_id = None
+        # Read from the start, the acks that make room in the window
+        # arrive that way
+        if not self._async_readers:
+            loop.add_reader(fd, self._read_available)
+        self._async_readers += 1
+        try:
+            while self._window_full():
+                if loop.time() >= deadline:
+                    raise TimeoutError("No room in the window for a trigger")
+                await asyncio.sleep(0.05)
+            remaining = deadline - loop.time()
+            request_id, _ = self._request(
+                PacketOutType.TRIGGER, b"", remaining,
+            )
+            self._sample_futures[request_id] = future
+            try:
+                return await asyncio.wait_for(future, remaining)
+            except asyncio.TimeoutError:
+                raise TimeoutError(f"No sample for request {request_id}")
+        finally:
+            self._sample_futures.pop(request_id, None)
+            self._async_readers -= 1
+            if not self._async_readers:
+                loop.remove_reader(fd)
+
     def _parse_message(self, message: bytes) -> None:
         message_size = len(message)
         logging.debug("Message in (%d): %s", message_size, list(message))
@@ -133,12 +596,13 @@ class Connection:
             )
             return
 
-        crc = binascii.crc32(message[:-crc_size])
-        if crc.to_bytes(4) != message[-crc_size:]:
+        crc = device_crc32(message[:-crc_size])
+        if crc.to_bytes(4, "little") != message[-crc_size:]:
             logging.error("CRC32 check failed: %08X", crc)
+            self._stats.crc_errors += 1
             return
 
-        version, type_ = struct.unpack(
+        version, type_, flags, seq, request_id = struct.unpack(
             Connection.HEADER_STRUCT,
             message[:header_size],
         )
@@ -150,6 +614,8 @@ class Connection:
             )
             return
 
+        self._count_seq(seq, bool(flags & Connection.FLAG_BOOT))
+
         try:
             type_ = PacketInType(type_)
         except ValueError:
@@ -165,8 +631,26 @@ class Connection:
             logging.error("No handler function for %s", type_.name)
             return
 
+        self._rx_request_id = request_id
         function(payload)
 
+    def _count_seq(self, seq: int, booting: bool) -> None:
+        stats = self._stats
+        stats.received += 1
+        if self._rx_seq is not None:
+            gap = (seq - self._rx_seq) & 0xFFFF
+            if booting and (not self._rx_booting or gap >= 0x8000):
+                # Device reset and started counting again, anything before
+                # this packet since then was lost
+                stats.restarts += 1
+                stats.lost += seq
+            elif gap < 0x8000:
+                stats.lost += gap
+            else:
+                logging.warning("Sequence went backwards: %d", seq)
+        self._rx_seq = (seq + 1) & 0xFFFF
+        self._rx_booting = booting
+
     def _handle_nop(self, payload):
         logging.info("Received NOP message")
 
@@ -178,12 +662,107 @@ class Connection:
         )
         self._temperature = float(temperature) / 100.
         self._relative_humidity = float(relative_humidity) / 100.
+        if self.on_measurements is not None:
+            self.on_measurements(self._temperature, self._relative_humidity)
 
     def _handle_health(self, payload):
         logging.info("Received HEALTH message")
 
     def _handle_event(self, payload):
         logging.info("Received EVENT message")
+        event_size = struct.calcsize(self.EVENT_STRUCT)
+        if len(payload) % event_size:
+            logging.error(
+                "EVENT payload not a multiple of %d: %d",
+                event_size, len(payload),
+            )
+            return
+        for timestamp_ms, type_, count, arg in struct.iter_unpack(
+            self.EVENT_STRUCT,
+            payload,
+        ):
+            try:
+                type_ = EventType(type_)
+            except ValueError:
+                logging.warning("Received unknown event type: %d", type_)
+            self._events.append(Event(type_, timestamp_ms, count, arg))
+
+    def _handle_fw_status(self, payload):
+        logging.info("Received FW_STATUS message")
+        self._fw_statuses.append(FwStatus(*struct.unpack(
+            self.FW_STATUS_STRUCT,
+            payload,
+        )))
+
+    def _handle_profile(self, payload):
+        logging.info("Received PROFILE message")
+        header_size = struct.calcsize(self.PROFILE_STRUCT)
+        base, shift, last, snapshot = struct.unpack(
+            self.PROFILE_STRUCT,
+            payload[:header_size],
+        )
+        if self._profile is None or self._profile.snapshot != snapshot:
+            # A snapshot cut short on the device is dropped, its samples
+            # are carried into the next one
+            self._profile = Profile(snapshot, base, shift)
+        for bucket, count in struct.iter_unpack(
+            self.PROFILE_ENTRY_STRUCT,
+            payload[header_size:],
+        ):
+            if bucket == self.PROFILE_BUCKET_OTHER:
+                self._profile.other += count
+            else:
+                self._profile.counts[bucket] = count
+        if last:
+            self._profiles.append(self._profile)
+            self._profile = None
+
+    def _handle_ack(self, payload):
+        logging.info("Received ACK message")
+        request = self._requests.pop(self._rx_request_id, None)
+        if request is None:
+            logging.warning("ACK for unknown request %d", self._rx_request_id)
+            return
+        if not request.future.done():
+            request.future.set_result(None)
+
+    def _handle_nack(self, payload):
+        logging.info("Received NACK message")
+        reason, = struct.unpack(self.NACK_STRUCT, payload)
+        try:
+            reason = NackReason(reason)
+        except ValueError:
+            logging.warning("Received unknown NACK reason: %d", reason)
+        request_id = self._rx_request_id
+        error = NackError(reason)
+        # A TRIGGER can also be NACKed after its ACK, when the sensor fails
+        if request_id in self._samples:
+            self._samples[request_id] = error
+        future = self._sample_futures.get(request_id)
+        if future is not None and not future.done():
+            future.set_exception(error)
+        request = self._requests.pop(request_id, None)
+        if request is None:
+            if future is None and request_id not in self._samples:
+                logging.warning("NACK for unknown request %d", request_id)
+            return
+        if not request.future.done():
+            request.future.set_exception(error)
+
+    def _handle_sample(self, payload):
+        logging.info("Received SAMPLE message")
+        request_id = self._rx_request_id
+        temperature, relative_humidity = struct.unpack(
+            self.MEASUREMENTS_STRUCT,
+            payload,
+        )
+        # The same measurement also arrives as MEASUREMENTS
+        sample = (float(temperature) / 100., float(relative_humidity) / 100.)
+        if request_id in self._samples:
+            self._samples[request_id] = sample
+        future = self._sample_futures.get(request_id)
+        if future is not None and not future.done():
+            future.set_result(sample)
 
     def _parse_leftovers(self) -> None:
         index = self._leftovers.find(b"\x00")
@@ -205,8 +784,15 @@ class Connection:
         rs, *_ = select.select([self._serial], [], [], timeout)
         for r in rs:
             if r is self._serial:
-                self._leftovers += self._serial.read(self._serial.in_waiting)
-                self._parse_leftovers()
+                self._read_available()
+        if not rs:
+            # Otherwise done as data is read
+            self._expire_requests()
+
+    def _read_available(self) -> None:
+        self._leftovers += self._serial.read(self._serial.in_waiting)
+        self._parse_leftovers()
+        self._expire_requests()
 
     @property
     def temperature(self):
@@ -228,15 +814,56 @@ class Connection:
         """
         return self._relative_humidity
 
+    @property
+    def link_stats(self) -> LinkStats:
+        """LinkStats: A copy of the statistics of packets received."""
+        return dataclasses.replace(self._stats)
+
+    def pop_events(self) -> list[Event]:
+        """
+        Take all events received since the last call.
+
+        Only the latest `EVENTS_MAX_QUEUED` events are kept.
+
+        Returns:
+            The received events, oldest first.
+        """
+        events = list(self._events)
+        self._events.clear()
+        return events
+
+    def pop_fw_statuses(self) -> list[FwStatus]:
+        """
+        Take all firmware update statuses received since the last call.
+
+        Returns:
+            The received statuses, oldest first.
+        """
+        statuses = list(self._fw_statuses)
+        self._fw_statuses.clear()
+        return statuses
+
+    def pop_profiles(self) -> list[Profile]:
+        """
+        Take all complete profiler snapshots received since the last call.
+
+        Returns:
+            The received snapshots, oldest first.
+        """
+        profiles = list(self._profiles)
+        self._profiles.clear()
+        return profiles
+
 
-def connect(tty: str = "/dev/ttyACM0"):
+def connect(tty: str = "/dev/ttyACM0", **kwargs):
     """
     Create and return a new `Connection` instance.
 
     Args:
         tty: Path to the serial device.
+        **kwargs: Passed on to `Connection`.
 
     Returns:
         Connection: A new connection object for communicating with the device.
     """
-    return Connection(tty=tty)
+    return Connection(tty=tty, **kwargs)
@@ -0,0 +1,274 @@
+"""
+Daemon owning the serial ports and fanning measurements out locally.
+
+Only one process can have a device's serial port open. The daemon owns all
+of them and publishes every decoded measurement into a shared-memory ring
+(see `pyeese.shm`) that any number of local processes can read without
+going through the daemon.
+
+A Unix socket, by default in $XDG_RUNTIME_DIR, takes control commands,
+one JSON object per line, each answered by one JSON object per line:
+    {"cmd": "info"}
+        -> {"ok": true, "shm": <name>, "devices": [...],
+            "slot_count": <n>, "write_seq": <n>}
+    {"cmd": "reset", "device": <name>}
+        -> {"ok": true}
+    {"cmd": "nop", "device": <name>}
+        -> {"ok": true}
+Errors are answered with {"ok": false, "error": <message>}.
+
+A device whose port fails (e.g. it was unplugged) is closed and reopened
+every `REOPEN_INTERVAL` seconds, the other devices carry on meanwhile.
+
+Intended usage:
+    python3 -m pyeese.daemon /dev/ttyACM0 /dev/ttyACM1
+"""
+import argparse
+import json
+import logging
+import os
+import select
+import socket
+import stat
+import tempfile
+import time
+
+import serial
+
+from .connection import Connection, WindowFullError
+from .shm import SampleWriter
+
+
+DEFAULT_SHM_NAME = "pyeese"
+DEFAULT_SOCKET = os.path.join(
+    os.environ.get("XDG_RUNTIME_DIR", tempfile.gettempdir()), "pyeese.sock",
+)
+REOPEN_INTERVAL = 1.0
+
+
+class DaemonError(Exception):
+    """Raised when the daemon cannot start."""
+
+
+def _claim_socket_path(path: str) -> None:
+    # Only ever remove a socket nobody is listening on, never another
+    # daemon's or something that is not a socket at all
+    try:
+        mode = os.stat(path).st_mode
+    except FileNotFoundError:
+        return
+    if not stat.S_ISSOCK(mode):
+        raise DaemonError(f"{path} exists and is not a socket")
+    probe = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        probe.connect(path)
+    except ConnectionRefusedError:
+        os.unlink(path)
+        return
+    finally:
+        probe.close()
+    raise DaemonError(f"{path} is in use, is another daemon running?")
+
+
+class Daemon:
+    """
+    Owns a set of device connections, publishing their measurements to
+    shared memory and serving control commands on a Unix socket.
+    """
+    def __init__(
+        self,
+        ttys: list[str],
+        shm_name: str = DEFAULT_SHM_NAME,
+        socket_path: str = DEFAULT_SOCKET,
+        slot_count: int = 4096,
+    ):
+        self._ttys = list(ttys)
+        # None while a device's port is down, waiting to be reopened
+        self._conns = []
+        self._reopen_at = 0.0
+        self._clients = {}
+        self._writer = SampleWriter(shm_name, self._ttys, slot_count)
+        self._slot_count = slot_count
+        try:
+            for index in range(len(self._ttys)):
+                self._conns.append(self._open(index))
+            _claim_socket_path(socket_path)
+            self._socket_path = socket_path
+            self._server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self._server.bind(socket_path)
+            self._server.listen()
+            self._server.setblocking(False)
+        except Exception:
+            self.close()
+            raise
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    @property
+    def shm_name(self) -> str:
+        """str: Name of the shared memory samples are published to."""
+        return self._writer.name
+
+    def _publisher(self, index: int):
+        def publish(temperature, relative_humidity):
+            self._writer.publish(index, temperature, relative_humidity)
+        return publish
+
+    def _open(self, index: int) -> Connection:
+        conn = Connection(tty=self._ttys[index])
+        conn.on_measurements = self._publisher(index)
+        return conn
+
+    def _port_failed(self, index: int, error: Exception) -> None:
+        logging.warning("Closing %s: %s", self._ttys[index], error)
+        try:
+            self._conns[index].close()
+        except (serial.SerialException, OSError):
+            pass
+        self._conns[index] = None
+        self._reopen_at = time.monotonic() + REOPEN_INTERVAL
+
+    def _reopen(self) -> None:
+        if time.monotonic() < self._reopen_at:
+            return
+        for index, conn in enumerate(self._conns):
+            if conn is not None:
+                continue
+            try:
+                self._conns[index] = self._open(index)
+                logging.warning("Reopened %s", self._ttys[index])
+            except (serial.SerialException, OSError):
+                self._reopen_at = time.monotonic() + REOPEN_INTERVAL
+
+    def close(self) -> None:
+        """Close all ports and the control socket, remove shared memory."""
+        for client in list(self._clients):
+            client.close()
+        self._clients = {}
+        if getattr(self, "_server", None) is not None:
+            self._server.close()
+            self._server = None
+            os.unlink(self._socket_path)
+        for conn in self._conns:
+            if conn is not None:
+                conn.close()
+        self._conns = []
+        if self._writer is not None:
+            self._writer.close()
+            self._writer = None
+
+    def _command(self, request: dict) -> dict:
+        cmd = request.get("cmd")
+        if cmd == "info":
+            return {
+                "ok": True,
+                "shm": self._writer.name,
+                "devices": self._ttys,
+                "slot_count": self._slot_count,
+                "write_seq": self._writer.write_seq,
+            }
+        if cmd in ("reset", "nop"):
+            try:
+                index = self._ttys.index(request.get("device"))
+            except ValueError:
+                return {"ok": False, "error": "unknown device"}
+            conn = self._conns[index]
+            if conn is None:
+                return {"ok": False, "error": "device unavailable"}
+            try:
+                if cmd == "reset":
+                    conn.send_reset()
+                else:
+                    conn.send_nop()
+            except WindowFullError:
+                return {"ok": False, "error": "busy"}
+            except (serial.SerialException, OSError) as e:
+                self._port_failed(index, e)
+                return {"ok": False, "error": "device unavailable"}
+            return {"ok": True}
+        return {"ok": False, "error": f"unknown command: {cmd}"}
+
+    def _drop_client(self, client: socket.socket) -> None:
+        client.close()
+        del self._clients[client]
+
+    def _serve_client(self, client: socket.socket) -> None:
+        try:
+            data = client.recv(4096)
+        except OSError as e:
+            logging.warning("Dropping control client: %s", e)
+            self._drop_client(client)
+            return
+        if not data:
+            self._drop_client(client)
+            return
+        buf = self._clients[client] + data
+        *lines, self._clients[client] = buf.split(b"\n")
+        for line in lines:
+            try:
+                response = self._command(json.loads(line))
+            except (ValueError, AttributeError):
+                response = {"ok": False, "error": "bad request"}
+            try:
+                client.sendall(json.dumps(response).encode() + b"\n")
+            except OSError as e:
+                # A client going away must not take the daemon with it
+                logging.warning("Dropping control client: %s", e)
+                self._drop_client(client)
+                return
+
+    def iterate(self, timeout: float = 0.25) -> None:
+        """
+        Wait for data from any device or control client and handle it.
+
+        Args:
+            timeout: Timeout in seconds for waiting.
+        """
+        self._reopen()
+        conns = [conn for conn in self._conns if conn is not None]
+        rs, *_ = select.select(
+            conns + [self._server] + list(self._clients), [], [], timeout,
+        )
+        for r in rs:
+            if r is self._server:
+                client, _ = self._server.accept()
+                self._clients[client] = b""
+            elif isinstance(r, Connection):
+                try:
+                    r.iterate(0)
+                except (serial.SerialException, OSError) as e:
+                    self._port_failed(self._conns.index(r), e)
+            else:
+                self._serve_client(r)
+
+    def run(self) -> None:
+        """Serve until interrupted."""
+        try:
+            while True:
+                self.iterate()
+        except KeyboardInterrupt:
+            pass
+
+
+def main() -> None:
+    """Command line entry point."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("ttys", nargs="+", help="Serial devices to own")
+    parser.add_argument("--shm", default=DEFAULT_SHM_NAME,
+                        help="Name of the shared memory to publish to")
+    parser.add_argument("--socket", default=DEFAULT_SOCKET,
+                        help="Path of the control socket")
+    parser.add_argument("--slots", type=int, default=4096,
+                        help="Number of samples kept in the ring")
+    args = parser.parse_args()
+    logging.basicConfig(level=logging.WARNING)
+    with Daemon(args.ttys, args.shm, args.socket, args.slots) as daemon:
+        daemon.run()
+
+
+if __name__ == "__main__":
+    main()
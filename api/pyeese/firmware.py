@@ -0,0 +1,211 @@
+"""
+Firmware update of a device over its serial link.
+
+The image is streamed as CRC32-protected blocks, keeping a window of blocks
+in flight rather than waiting for each one to be acknowledged. The device
+replies to every block with its next expected offset, which acks everything
+before it. A lost or corrupt block makes the host go back to that offset.
+
+Starting an update with the same image as an interrupted one resumes it
+from where the device got to.
+
+Intended usage:
+    with connect("/dev/ttyACM0") as conn:
+        update_file(conn, "build/firmware.bin")
+
+Or from the command line:
+    python3 -m pyeese.firmware /dev/ttyACM0 build/firmware.bin
+"""
+import argparse
+import enum
+import logging
+import time
+import typing
+
+from .connection import Connection, FwStatus, connect, device_crc32
+
+
+class FwState(enum.Enum):
+    """Enumeration of the device's firmware update states."""
+    IDLE = 0
+    RECEIVING = 1
+    COMPLETE = 2
+
+
+class FwResult(enum.Enum):
+    """Enumeration of the device's firmware update command results."""
+    OK = 0
+    BAD_ARG = 1
+    TOO_BIG = 2
+    NOT_STARTED = 3
+    OUT_OF_ORDER = 4
+    BAD_CRC = 5
+    FLASH = 6
+    IMAGE_CRC = 7
+    INCOMPLETE = 8
+    BAD_IMAGE = 9
+
+
+class FirmwareUpdateError(Exception):
+    """Raised when a firmware update cannot be completed."""
+
+
+# Erasing the download slot happens before the begin command is answered
+BEGIN_TIMEOUT = 5.0
+
+
+def _wait_statuses(conn: Connection, timeout: float) -> list[FwStatus]:
+    deadline = time.monotonic() + timeout
+    while True:
+        statuses = conn.pop_fw_statuses()
+        if statuses:
+            return statuses
+        remaining = deadline - time.monotonic()
+        if remaining <= 0:
+            return []
+        conn.iterate(min(remaining, 0.25))
+
+
+def _command(conn: Connection, send: typing.Callable[[], object],
+             timeout: float, retries: int) -> FwStatus:
+    for _ in range(retries + 1):
+        conn.wait_room()
+        send()
+        statuses = _wait_statuses(conn, timeout)
+        if statuses:
+            return statuses[-1]
+    raise FirmwareUpdateError("No response from device")
+
+
+def update(
+    conn: Connection,
+    image: bytes,
+    window: int = 16,
+    timeout: float = 1.0,
+    retries: int = 5,
+    apply: bool = True,
+    progress: typing.Callable[[int, int], None] | None = None,
+) -> None:
+    """
+    Send a firmware image to the device.
+
+    Args:
+        conn: Connection to the device.
+        image: The raw firmware image (e.g. the contents of firmware.bin).
+        window: Maximum number of blocks in flight.
+        timeout: Seconds to wait for a response before resending.
+        retries: Number of times to resend without progress before giving
+            up.
+        apply: Reset the device into the new firmware once sent.
+        progress: Called with (bytes acked, image size) as blocks are
+            acked.
+
+    Raises:
+        FirmwareUpdateError: If the device rejects the image or stops
+            responding.
+    """
+    size = len(image)
+    block_max = Connection.FW_BLOCK_MAX
+    conn.pop_fw_statuses()
+    status = _command(
+        conn,
+        lambda: conn.send_fw_begin(size, device_crc32(image)),
+        BEGIN_TIMEOUT,
+        retries,
+    )
+    if FwResult(status.result) != FwResult.OK:
+        raise FirmwareUpdateError(
+            f"Device refused image: {FwResult(status.result).name}"
+        )
+    acked = status.offset
+    if acked:
+        logging.info("Resuming firmware update from %d", acked)
+    next_offset = acked
+    last_rewind = None
+    attempts = retries
+    while acked < size:
+        while next_offset < size and next_offset - acked < window * block_max:
+            block = image[next_offset:next_offset + block_max]
+            conn.wait_room()
+            conn.send_fw_block(next_offset, block)
+            next_offset += len(block)
+        statuses = _wait_statuses(conn, timeout)
+        if not statuses:
+            attempts -= 1
+            if attempts < 0:
+                raise FirmwareUpdateError(
+                    f"No response from device at offset {acked}"
+                )
+            logging.warning("Timed out, resending from %d", acked)
+            next_offset = acked
+            continue
+        for status in statuses:
+            result = FwResult(status.result)
+            if FwState(status.state) != FwState.RECEIVING:
+                raise FirmwareUpdateError(
+                    f"Device left update at offset {acked}: {result.name}"
+                )
+            if status.offset > acked:
+                acked = status.offset
+                attempts = retries
+                if progress:
+                    progress(acked, size)
+            if result in (FwResult.OUT_OF_ORDER, FwResult.BAD_CRC):
+                # Blocks already in flight after a lost one will all be
+                # refused for the same offset, only go back once for them
+                if status.offset != last_rewind:
+                    logging.warning(
+                        "%s, resending from %d", result.name, status.offset,
+                    )
+                    next_offset = status.offset
+                    last_rewind = status.offset
+            elif result != FwResult.OK:
+                raise FirmwareUpdateError(
+                    f"Block at {status.offset} failed: {result.name}"
+                )
+
+    status = _command(conn, conn.send_fw_end, timeout, retries)
+    if FwResult(status.result) != FwResult.OK:
+        raise FirmwareUpdateError(
+            f"Image check failed: {FwResult(status.result).name}"
+        )
+    if apply:
+        conn.send_reset()
+
+
+def update_file(conn: Connection, path: str, **kwargs) -> None:
+    """
+    Send a firmware image file to the device.
+
+    Args:
+        conn: Connection to the device.
+        path: Path to the raw firmware image (e.g. build/firmware.bin).
+        **kwargs: Passed on to `update()`.
+    """
+    with open(path, "rb") as f:
+        image = f.read()
+    update(conn, image, **kwargs)
+
+
+def main() -> None:
+    """Command line entry point."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("tty", help="Serial device of the target")
+    parser.add_argument("image", help="Raw firmware image, e.g. firmware.bin")
+    parser.add_argument("--window", type=int, default=16,
+                        help="Maximum blocks in flight")
+    parser.add_argument("--no-apply", action="store_true",
+                        help="Do not reset into the new firmware")
+    args = parser.parse_args()
+
+    def _progress(done, total):
+        print(f"\r{done}/{total} bytes", end="", flush=True)
+
+    with connect(args.tty) as conn:
+        update_file(conn, args.image, window=args.window,
+                    apply=not args.no_apply, progress=_progress)
+    print()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,177 @@
+"""
+Flat profile of a device from its PC-sampling profiler.
+
+The firmware must be built with `make PROFILER=1`. It then streams a
+histogram of sampled program counters, bucketed by address range, every few
+seconds. The buckets are symbolised against the firmware ELF, splitting a
+bucket's samples between the functions it overlaps by size.
+
+Intended usage:
+    with connect("/dev/ttyACM0") as conn:
+        samples = collect(conn, duration=30.)
+    symbols = load_symbols("build/firmware.elf")
+    print(format_flat(symbolise(samples, symbols)))
+
+Or from the command line:
+    python3 -m pyeese.profile /dev/ttyACM0 build/firmware.elf
+"""
+import argparse
+import bisect
+import dataclasses
+import subprocess
+import time
+
+from .connection import Connection, Profile, connect
+
+
+UNKNOWN = "[unknown]"
+OTHER = "[outside firmware]"
+
+
+@dataclasses.dataclass(frozen=True)
+class Symbol:
+    """A function in the firmware image."""
+    address: int
+    size: int
+    name: str
+
+
+def load_symbols(elf: str, nm: str = "arm-none-eabi-nm") -> list[Symbol]:
+    """
+    Read the function symbols of an ELF file.
+
+    Args:
+        elf: Path to the firmware ELF (e.g. build/firmware.elf).
+        nm: The `nm` to use.
+
+    Returns:
+        The sized function symbols, sorted by address.
+    """
+    output = subprocess.run(
+        [nm, "--print-size", "--numeric-sort", "--defined-only", elf],
+        check=True, capture_output=True, text=True,
+    ).stdout
+    symbols = []
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) != 4 or fields[2] not in "tTwW":
+            continue
+        # Thumb function addresses have bit 0 set
+        address = int(fields[0], 16) & ~1
+        symbols.append(Symbol(address, int(fields[1], 16), fields[3]))
+    return sorted(symbols, key=lambda s: s.address)
+
+
+def merge(profiles: list[Profile]) -> Profile | None:
+    """
+    Add up profiler snapshots.
+
+    Args:
+        profiles: Snapshots from the same firmware.
+
+    Returns:
+        A single snapshot with all the samples, or None if none were given.
+    """
+    if not profiles:
+        return None
+    first = profiles[0]
+    merged = Profile(first.snapshot, first.base, first.shift)
+    for profile in profiles:
+        merged.other += profile.other
+        for bucket, count in profile.counts.items():
+            merged.counts[bucket] = merged.counts.get(bucket, 0) + count
+    return merged
+
+
+def symbolise(profile: Profile, symbols: list[Symbol]) -> dict[str, float]:
+    """
+    Attribute a profile's samples to functions.
+
+    Args:
+        profile: The profiler histogram.
+        symbols: Function symbols sorted by address, see `load_symbols()`.
+
+    Returns:
+        Samples per function name.
+    """
+    ends = [s.address + s.size for s in symbols]
+    bucket_size = 1 << profile.shift
+    samples = {}
+    if profile.other:
+        samples[OTHER] = float(profile.other)
+    for bucket, count in profile.counts.items():
+        start = profile.base + (bucket << profile.shift)
+        end = start + bucket_size
+        unattributed = float(count)
+        index = bisect.bisect_right(ends, start)
+        while index < len(symbols) and symbols[index].address < end:
+            symbol = symbols[index]
+            overlap = min(end, ends[index]) - max(start, symbol.address)
+            if overlap > 0:
+                share = count * overlap / bucket_size
+                samples[symbol.name] = samples.get(symbol.name, 0.) + share
+                unattributed -= share
+            index += 1
+        if unattributed > 1e-9:
+            samples[UNKNOWN] = samples.get(UNKNOWN, 0.) + unattributed
+    return samples
+
+
+def format_flat(samples: dict[str, float]) -> str:
+    """
+    Format samples per function as a flat profile, busiest first.
+
+    Args:
+        samples: Samples per function name, see `symbolise()`.
+
+    Returns:
+        The flat profile as text.
+    """
+    total = sum(samples.values())
+    lines = [f"{'%':>7} {'samples':>10}  function"]
+    for name, count in sorted(samples.items(), key=lambda i: -i[1]):
+        percent = 100. * count / total if total else 0.
+        lines.append(f"{percent:7.2f} {count:10.1f}  {name}")
+    return "\n".join(lines)
+
+
+def collect(conn: Connection, duration: float) -> Profile | None:
+    """
+    Collect profiler snapshots from a device for a while.
+
+    Args:
+        conn: Connection to the device.
+        duration: Seconds to collect for.
+
+    Returns:
+        All the snapshots merged, or None if none were received.
+    """
+    profiles = []
+    deadline = time.monotonic() + duration
+    while time.monotonic() < deadline:
+        conn.iterate()
+        profiles += conn.pop_profiles()
+    return merge(profiles)
+
+
+def main() -> None:
+    """Command line entry point."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("tty", help="Serial device of the target")
+    parser.add_argument("elf", help="Firmware ELF, e.g. build/firmware.elf")
+    parser.add_argument("--duration", type=float, default=30.,
+                        help="Seconds to collect samples for")
+    parser.add_argument("--nm", default="arm-none-eabi-nm",
+                        help="nm to read the ELF's symbols with")
+    args = parser.parse_args()
+
+    symbols = load_symbols(args.elf, nm=args.nm)
+    with connect(args.tty) as conn:
+        profile = collect(conn, args.duration)
+    if profile is None:
+        raise SystemExit("No profile received, is it built with PROFILER=1?")
+    print(format_flat(symbolise(profile, symbols)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,364 @@
+"""
+Shared-memory ring of decoded measurements for many local readers.
+
+One writer (see `pyeese.daemon`) publishes samples, any number of readers
+in other processes map the same memory and read without locks or
+syscalls. Readers map the memory read-write (that is all `SharedMemory`
+offers) but never write to it, so adding readers has no cost for the
+writer.
+
+Layout (little-endian):
+    [header]
+        magic: uint32, version: uint16, max_devices: uint16,
+        slot_count: uint32, writer_pid: uint32, write_seq: uint64
+    [device names]     max_devices x 32 byte UTF-8, NUL padded
+    [latest samples]   max_devices x slot, latest sample of each device
+    [ring]             slot_count x slot, every sample in order
+
+    slot: seq: uint64, device: uint32, reserved: uint32,
+          timestamp: float64, temperature: float64,
+          relative_humidity: float64
+
+Each slot is a seqlock: the writer sets `seq` to WRITING, writes the
+sample, then sets `seq` to the sample's sequence number (starting at 1, 0
+being an empty slot). A reader copies a slot and only accepts it if `seq`
+is the same before and after the copy and not WRITING. `write_seq` is the
+last sequence number published.
+
+A writer left behind by a process that died (e.g. a daemon crash) is
+detected from `writer_pid` and replaced by the next writer.
+
+Intended usage:
+    reader = SampleReader("pyeese")
+    latest = reader.latest("/dev/ttyACM0")
+    for sample in reader.read_new():
+        ...
+"""
+import dataclasses
+import os
+import struct
+import time
+
+from multiprocessing import resource_tracker, shared_memory
+
+
+MAGIC = 0x45534545  # "EESE"
+VERSION = 1
+HEADER_STRUCT = "<IHHIIQ"
+NAME_SIZE = 32
+SLOT_STRUCT = "<QIIddd"
+WRITING = 0xFFFFFFFFFFFFFFFF
+# A write takes microseconds, a slot torn for this many reads in a row was
+# left by a writer that died mid-write
+TORN_RETRIES = 10000
+
+_HEADER_SIZE = struct.calcsize(HEADER_STRUCT)
+_SLOT_SIZE = struct.calcsize(SLOT_STRUCT)
+_WRITE_SEQ_OFFSET = _HEADER_SIZE - 8
+
+# Shared memory created by writers in this process
+_created = set()
+
+
+class ShmError(Exception):
+    """Raised when the shared memory is not a valid sample ring."""
+
+
+@dataclasses.dataclass(frozen=True)
+class Sample:
+    """
+    A measurement published by the daemon.
+
+    Attributes:
+        seq: Sequence number, consecutive across all devices.
+        device: Index of the device it came from.
+        timestamp: Host time it was received (seconds since the epoch).
+        temperature: Degrees Celsius.
+        relative_humidity: Percent.
+    """
+    seq: int
+    device: int
+    timestamp: float
+    temperature: float
+    relative_humidity: float
+
+
+def _size(max_devices: int, slot_count: int) -> int:
+    return (_HEADER_SIZE + max_devices * (NAME_SIZE + _SLOT_SIZE)
+            + slot_count * _SLOT_SIZE)
+
+
+class _Layout:
+    def __init__(self, buf: memoryview):
+        self.buf = buf
+        magic, version, self.max_devices, self.slot_count, self.writer_pid, _ = (
+            struct.unpack_from(HEADER_STRUCT, buf, 0)
+        )
+        if magic != MAGIC or version != VERSION:
+            raise ShmError(f"Not a sample ring ({magic:08X} v{version})")
+        self.names_offset = _HEADER_SIZE
+        self.latest_offset = self.names_offset + self.max_devices * NAME_SIZE
+        self.ring_offset = self.latest_offset + self.max_devices * _SLOT_SIZE
+
+    def write_seq(self) -> int:
+        return struct.unpack_from("<Q", self.buf, _WRITE_SEQ_OFFSET)[0]
+
+    def names(self) -> list[str]:
+        names = []
+        for i in range(self.max_devices):
+            offset = self.names_offset + i * NAME_SIZE
+            raw = bytes(self.buf[offset:offset + NAME_SIZE]).rstrip(b"\x00")
+            if not raw:
+                break
+            names.append(raw.decode())
+        return names
+
+    def ring_slot(self, seq: int) -> int:
+        return self.ring_offset + ((seq - 1) % self.slot_count) * _SLOT_SIZE
+
+    def latest_slot(self, device: int) -> int:
+        return self.latest_offset + device * _SLOT_SIZE
+
+    def write_slot(self, offset: int, seq: int, device: int,
+                   timestamp: float, temperature: float,
+                   relative_humidity: float) -> None:
+        struct.pack_into("<Q", self.buf, offset, WRITING)
+        struct.pack_into(
+            SLOT_STRUCT, self.buf, offset,
+            WRITING, device, 0, timestamp, temperature, relative_humidity,
+        )
+        struct.pack_into("<Q", self.buf, offset, seq)
+
+    def read_slot(self, offset: int) -> Sample | None | bool:
+        """Copy a slot, None if empty and False if torn by a write."""
+        values = struct.unpack_from(SLOT_STRUCT, self.buf, offset)
+        after = struct.unpack_from("<Q", self.buf, offset)[0]
+        if values[0] == WRITING or values[0] != after:
+            return False
+        if not values[0]:
+            return None
+        return Sample(values[0], values[1], *values[3:])
+
+
+def _pid_alive(pid: int) -> bool:
+    if not pid:
+        return False
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+
+def _remove_stale(name: str) -> None:
+    """Remove shared memory `name` unless a live writer owns it."""
+    try:
+        shm = shared_memory.SharedMemory(name=name)
+    except FileNotFoundError:
+        return
+    try:
+        writer_pid = _Layout(shm.buf).writer_pid
+    except (ShmError, struct.error):
+        writer_pid = 0
+    # Attaching registered it to be removed at exit, unlink() undoes that
+    shm.close()
+    if _pid_alive(writer_pid):
+        resource_tracker.unregister(shm._name, "shared_memory")
+        raise FileExistsError(
+            f"Shared memory {name} is in use by process {writer_pid}"
+        )
+    shm.unlink()
+
+
+class SampleWriter:
+    """
+    Creates the shared memory and publishes samples into it.
+
+    Only one writer may exist for a given name, shared memory left behind
+    by a writer that is no longer running is replaced.
+
+    Raises:
+        ValueError: If a device name is longer than `NAME_SIZE` bytes.
+        FileExistsError: If a running writer already uses the name.
+    """
+    def __init__(self, name: str, devices: list[str],
+                 slot_count: int = 4096):
+        if len(devices) > 0xFFFF:
+            raise ValueError("Too many devices")
+        raw_names = [device.encode() for device in devices]
+        for device, raw in zip(devices, raw_names):
+            if len(raw) > NAME_SIZE:
+                raise ValueError(
+                    f"Device name longer than {NAME_SIZE} bytes: {device}"
+                )
+        size = _size(len(devices), slot_count)
+        try:
+            self._shm = shared_memory.SharedMemory(
+                name=name, create=True, size=size,
+            )
+        except FileExistsError:
+            _remove_stale(name)
+            self._shm = shared_memory.SharedMemory(
+                name=name, create=True, size=size,
+            )
+        buf = self._shm.buf
+        buf[:] = bytes(len(buf))
+        struct.pack_into(
+            HEADER_STRUCT, buf, 0,
+            MAGIC, VERSION, len(devices), slot_count, os.getpid(), 0,
+        )
+        self._layout = _Layout(buf)
+        _created.add(self._shm.name)
+        for i, raw in enumerate(raw_names):
+            offset = self._layout.names_offset + i * NAME_SIZE
+            buf[offset:offset + len(raw)] = raw
+        self._seq = 0
+
+    @property
+    def name(self) -> str:
+        """str: Name of the shared memory, for readers to open."""
+        return self._shm.name
+
+    @property
+    def write_seq(self) -> int:
+        """int: Sequence number of the last sample published."""
+        return self._seq
+
+    def publish(self, device: int, temperature: float,
+                relative_humidity: float,
+                timestamp: float | None = None) -> int:
+        """
+        Publish a sample to all readers.
+
+        Args:
+            device: Index of the device it came from.
+            temperature: Degrees Celsius.
+            relative_humidity: Percent.
+            timestamp: When it was received, defaults to now.
+
+        Returns:
+            int: The sample's sequence number.
+        """
+        if timestamp is None:
+            timestamp = time.time()
+        self._seq += 1
+        layout = self._layout
+        layout.write_slot(
+            layout.ring_slot(self._seq), self._seq, device,
+            timestamp, temperature, relative_humidity,
+        )
+        layout.write_slot(
+            layout.latest_slot(device), self._seq, device,
+            timestamp, temperature, relative_humidity,
+        )
+        struct.pack_into("<Q", layout.buf, _WRITE_SEQ_OFFSET, self._seq)
+        return self._seq
+
+    def close(self) -> None:
+        """Stop publishing and remove the shared memory."""
+        if self._shm is not None:
+            self._layout = None
+            _created.discard(self._shm.name)
+            self._shm.close()
+            self._shm.unlink()
+            self._shm = None
+
+
+class SampleReader:
+    """
+    Maps a `SampleWriter`'s shared memory to read samples from it.
+
+    Readers never write to the shared memory, a reader that falls more than
+    a ring's worth of samples behind skips ahead and counts what it lost.
+    """
+    def __init__(self, name: str):
+        self._shm = shared_memory.SharedMemory(name=name)
+        if self._shm.name not in _created:
+            # Attaching registers the memory to be removed when this
+            # process exits, but it belongs to the writer
+            resource_tracker.unregister(self._shm._name, "shared_memory")
+        self._layout = _Layout(self._shm.buf)
+        self._devices = self._layout.names()
+        self._indexes = {name: i for i, name in enumerate(self._devices)}
+        self._next_seq = self._layout.write_seq() + 1
+        self.lost = 0
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    @property
+    def devices(self) -> list[str]:
+        """list[str]: Device names, in index order."""
+        return list(self._devices)
+
+    def index(self, device: str) -> int:
+        """
+        Look up a device's index from its name.
+
+        Args:
+            device: Device name, as given to the daemon.
+
+        Returns:
+            int: The device's index.
+        """
+        return self._indexes[device]
+
+    def latest(self, device: int | str) -> Sample | None:
+        """
+        Get the latest sample of a device.
+
+        Args:
+            device: Device index or name.
+
+        Returns:
+            The latest sample, or None if there is none yet.
+
+        Raises:
+            ShmError: If the writer died part way through writing it.
+        """
+        if isinstance(device, str):
+            device = self._indexes[device]
+        offset = self._layout.latest_slot(device)
+        for _ in range(TORN_RETRIES):
+            sample = self._layout.read_slot(offset)
+            if sample is not False:
+                return sample
+            # Torn by a concurrent write, which is quick so try again
+        raise ShmError(f"Latest sample of device {device} left mid-write")
+
+    def read_new(self) -> list[Sample]:
+        """
+        Read every sample published since the last call (or since the
+        reader was opened).
+
+        Returns:
+            The new samples, in order.
+        """
+        layout = self._layout
+        write_seq = layout.write_seq()
+        oldest = write_seq - layout.slot_count + 1
+        if self._next_seq < oldest:
+            self.lost += oldest - self._next_seq
+            self._next_seq = oldest
+        samples = []
+        while self._next_seq <= write_seq:
+            sample = layout.read_slot(layout.ring_slot(self._next_seq))
+            if not sample or sample.seq != self._next_seq:
+                # Overwritten while reading, the writer has lapped us
+                self.lost += 1
+            else:
+                samples.append(sample)
+            self._next_seq += 1
+        return samples
+
+    def close(self) -> None:
+        """Unmap the shared memory."""
+        if self._shm is not None:
+            self._layout = None
+            self._shm.close()
+            self._shm = None
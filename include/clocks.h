@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+typedef enum {
+    CLOCKS_CHANGE_PRE,      /* about to change, finish anything in flight */
+    CLOCKS_CHANGE_POST,     /* changed, re-derive anything clock dependent */
+} clocks_change_t;
+
+
+/* Anything needing the high clock holds it until it is done */
+typedef enum {
+    CLOCKS_HOLDER_FW_UPDATE = (1 << 0),
+} clocks_holder_t;
+
+
+typedef void (*clocks_notifier_t)(clocks_change_t change);
+
+
+void clocks_init(void);
+bool clocks_register_notifier(clocks_notifier_t notifier);
+void clocks_hold_high(clocks_holder_t holder, bool hold);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define CLOCKS_CALC_BAUD_TOLERANCE_PPM       20000UL
+
+
+bool clocks_calc_systick_reload(uint32_t ahb_hz, uint32_t tick_hz, uint32_t* reload);
+bool clocks_calc_usart_brr(uint32_t pclk_hz, uint32_t baud, uint32_t* brr);
+bool clocks_calc_i2c_timing_sm(uint32_t i2c_hz, uint32_t* timingr);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Meaning of the event argument is given per type */
+typedef enum {
+    EVENTS_TYPE_QUEUE_OVERFLOW = 1,     /* arg: number of events dropped */
+    EVENTS_TYPE_UART_ERROR = 2,         /* arg: USART_ISR error flags */
+    EVENTS_TYPE_UART_RX_OVERFLOW = 3,   /* arg: 0 */
+    EVENTS_TYPE_ITF_BAD_PACKET = 4,     /* arg: events_bad_packet_t */
+    EVENTS_TYPE_SENSOR_ERROR = 5,       /* arg: sensor state at failure */
+    EVENTS_TYPE_ISR_CYCLES = 6,         /* arg: new worst case, ISR_BENCH=1 only */
+} events_type_t;
+
+
+typedef enum {
+    EVENTS_BAD_PACKET_CRC = 1,
+    EVENTS_BAD_PACKET_VERSION = 2,
+    EVENTS_BAD_PACKET_TYPE = 3,
+} events_bad_packet_t;
+
+
+bool events_post(events_type_t type, uint32_t arg);
+void events_iterate(void);
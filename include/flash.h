@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* The upper half of flash is used as a download slot for firmware
+ * updates, the lower half holds the running firmware. */
+#define FLASH_SLOT_SIZE                 (64UL * 1024UL)
+#define FLASH_SLOT_PAGE_SIZE            2048UL
+
+
+bool flash_slot_erase(uint32_t len);
+bool flash_slot_write(uint32_t offset, const uint8_t* data, uint32_t len);
+bool flash_slot_read(uint32_t offset, uint8_t* data, uint32_t len);
+void flash_slot_apply(uint32_t len);
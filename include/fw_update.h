@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "itf.h"
+
+
+#define FW_UPDATE_BLOCK_MAX             64
+
+
+typedef enum {
+    FW_UPDATE_STATE_IDLE = 0,
+    FW_UPDATE_STATE_RECEIVING = 1,
+    FW_UPDATE_STATE_COMPLETE = 2,
+} fw_update_state_t;
+
+
+typedef enum {
+    FW_UPDATE_RESULT_OK = 0,
+    FW_UPDATE_RESULT_BAD_ARG = 1,
+    FW_UPDATE_RESULT_TOO_BIG = 2,
+    FW_UPDATE_RESULT_NOT_STARTED = 3,
+    FW_UPDATE_RESULT_OUT_OF_ORDER = 4,
+    FW_UPDATE_RESULT_BAD_CRC = 5,
+    FW_UPDATE_RESULT_FLASH = 6,
+    FW_UPDATE_RESULT_IMAGE_CRC = 7,
+    FW_UPDATE_RESULT_INCOMPLETE = 8,
+    FW_UPDATE_RESULT_BAD_IMAGE = 9,
+} fw_update_result_t;
+
+
+void fw_update_begin(uint32_t size, uint32_t crc, itf_fw_status_t* status);
+void fw_update_block(uint32_t offset, const uint8_t* data, uint32_t len, uint32_t crc, itf_fw_status_t* status);
+void fw_update_end(itf_fw_status_t* status);
+bool fw_update_apply(void);
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
 
 void htu21d_init(void);
+bool htu21d_trigger(uint16_t request_id);
 void htu21d_iterate(void);
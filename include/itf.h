@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <stdbool.h>
 
 
@@ -9,6 +10,58 @@ typedef struct {
 } __attribute__((packed)) itf_measurements_t;
 
 
+typedef struct {
+    uint32_t timestamp_ms;
+    uint16_t type; /* events_type_t */
+    uint16_t count;
+    uint32_t arg;
+} __attribute__((packed)) itf_event_t;
+
+
+typedef struct {
+    uint32_t size;
+    uint32_t crc;
+} __attribute__((packed)) itf_fw_begin_t;
+
+
+typedef struct {
+    uint32_t offset;
+    uint32_t crc;
+    /* followed by up to FW_UPDATE_BLOCK_MAX bytes of data */
+} __attribute__((packed)) itf_fw_block_t;
+
+
+typedef struct {
+    uint8_t state; /* fw_update_state_t */
+    uint8_t result; /* fw_update_result_t */
+    uint32_t offset; /* next offset expected */
+    uint32_t size;
+} __attribute__((packed)) itf_fw_status_t;
+
+
+typedef struct {
+    uint32_t base; /* address of bucket 0 */
+    uint8_t shift; /* bucket covers 1 << shift bytes */
+    uint8_t last; /* final packet of this snapshot */
+    uint16_t snapshot;
+    /* followed by itf_profile_entry_t for each non-empty bucket */
+} __attribute__((packed)) itf_profile_t;
+
+
+typedef struct {
+    uint16_t bucket; /* ITF_PROFILE_BUCKET_OTHER for outside firmware */
+    uint16_t count;
+} __attribute__((packed)) itf_profile_entry_t;
+
+
+#define ITF_PROFILE_BUCKET_OTHER        0xFFFF
+
+
 bool itf_send_nop(void);
 bool itf_send_measurements(itf_measurements_t* measurements);
+bool itf_send_sample(uint16_t request_id, itf_measurements_t* measurements);
+bool itf_send_sample_failed(uint16_t request_id);
+bool itf_send_events(itf_event_t* events, uint32_t count);
+bool itf_send_fw_status(itf_fw_status_t* status);
+bool itf_send_profile(itf_profile_t* profile, uint32_t count);
 void itf_iterate(void);
@@ -14,7 +14,10 @@
 #define UART_ITF_UART           USART2
 #define UART_ITF_CLK            RCC_USART2
 #define UART_ITF_IRQ            NVIC_USART2_IRQ
-#define UART_ITF_DMA_CHAN       DMA_CHANNEL4
+#define UART_ITF_DMA            DMA1
+#define UART_ITF_DMA_RCC        RCC_DMA1
+#define UART_ITF_DMA_TX_CHAN    DMA_CHANNEL4
+#define UART_ITF_DMA_RX_CHAN    DMA_CHANNEL5
 #define UART_ITF_DMA_IRQ        NVIC_DMA1_CHANNEL4_7_DMA2_CHANNEL3_5_IRQ
 
 #define I2C_HTU21D_PERIPH       I2C1
@@ -24,3 +27,13 @@
 #define I2C_HTU21D_GPIO_PORT    GPIOB
 #define I2C_HTU21D_PINS         (GPIO6 | GPIO7)
 #define I2C_HTU21D_AF           GPIO_AF1
+
+#define PROFILER_TIM            TIM14
+#define PROFILER_TIM_RCC        RCC_TIM14
+#define PROFILER_TIM_RST        RST_TIM14
+#define PROFILER_TIM_IRQ        NVIC_TIM14_IRQ
+
+/* Cortex-M0 only has the top two priority bits, lower is more urgent. The
+ * profiler has to be able to preempt everything else to sample it. */
+#define IRQ_PRIORITY_PROFILER   0x00
+#define IRQ_PRIORITY_DEFAULT    0x40
@@ -0,0 +1,10 @@
+#pragma once
+
+/* Only built with `make PROFILER=1` */
+#ifdef PROFILER_ENABLED
+void profiler_init(void);
+void profiler_iterate(void);
+#else
+static inline void profiler_init(void) {}
+static inline void profiler_iterate(void) {}
+#endif
@@ -1,26 +1,48 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 
+/* Ring buffers are single-producer/single-consumer: one side (e.g. an ISR)
+ * may only write and the other (e.g. the main loop) may only read. Indices
+ * are free-running and masked on access, so the size must be a power of
+ * two and the whole buffer is usable. */
 typedef struct {
     volatile uint8_t* buf;
-    uint32_t size;
+    uint32_t mask;
     volatile uint32_t r_pos;
     volatile uint32_t w_pos;
 } ring_buf_t;
 
 
-#define RING_BUF_INIT(_buf, _size)                                      \
+#define RING_BUF_IS_POW2(_size)         (((_size) != 0) && (((_size) & ((_size) - 1)) == 0))
+
+
+/* Internal to RING_BUF_DEFINE, which checks the size, rings must not be
+ * initialised any other way. */
+#define RING_BUF_INIT_UNCHECKED_(_buf, _size)                                     \
 {                                                                       \
     .buf = _buf,                                                        \
-    .size = _size,                                                      \
-    .r_pos = _size - 1,                                                 \
+    .mask = (_size) - 1,                                                \
+    .r_pos = 0,                                                         \
     .w_pos = 0                                                          \
 }
 
 
+/* Defines a statically allocated ring buffer `_name` with a backing
+ * buffer `_name##_buf` of `_size` bytes, checked at compile time. This is
+ * the only supported way to create a ring. */
+#define RING_BUF_DEFINE(_name, _size)                                   \
+_Static_assert(RING_BUF_IS_POW2(_size), #_name " size must be a power of two"); \
+static volatile uint8_t _name##_buf[_size] __attribute__((aligned(4))); \
+static ring_buf_t _name = RING_BUF_INIT_UNCHECKED_(_name##_buf, _size)
+
+
 uint32_t ring_buf_write(ring_buf_t* ring, uint8_t* data, uint32_t count);
+bool ring_buf_write_byte(ring_buf_t* ring, uint8_t c);
 uint32_t ring_buf_peek(ring_buf_t* ring, uint8_t* data, uint32_t count);
 uint32_t ring_buf_read(ring_buf_t* ring, uint8_t* data, uint32_t count);
 uint32_t ring_buf_read_until(ring_buf_t* ring, uint8_t* data, uint32_t count, uint8_t until);
+uint32_t ring_buf_used(ring_buf_t* ring);
+uint32_t ring_buf_space(ring_buf_t* ring);
@@ -5,3 +5,5 @@
 
 void systick_init(void);
 uint32_t get_since_boot_ms(void);
+uint32_t systick_cycles_now(void);
+uint32_t systick_cycles_since(uint32_t start);
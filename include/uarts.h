@@ -1,3 +1,4 @@
 #pragma once
 
 int uarts_init(void);
+void uarts_iterate(void);
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/flash.h>
+
+#include "clocks.h"
+
+
+#define CLOCKS_NOTIFIERS_MAX                4
+#define CLOCKS_LOW_HZ                       8000000UL
+
+
+static void _clocks_notify(clocks_change_t change);
+static void _clocks_set(bool high);
+
+
+static clocks_notifier_t _clocks_notifiers[CLOCKS_NOTIFIERS_MAX] = {0};
+static uint32_t _clocks_holders = 0;
+static bool _clocks_high = false;
+
+
+void clocks_init(void)
+{
+    /* start on the reset clock, HSI at 8MHz */
+    rcc_ahb_frequency = CLOCKS_LOW_HZ;
+    rcc_apb1_frequency = CLOCKS_LOW_HZ;
+    _clocks_high = false;
+}
+
+
+bool clocks_register_notifier(clocks_notifier_t notifier)
+{
+    for (uint32_t i = 0; i < CLOCKS_NOTIFIERS_MAX; i++) {
+        if (!_clocks_notifiers[i]) {
+            _clocks_notifiers[i] = notifier;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void clocks_hold_high(clocks_holder_t holder, bool hold)
+{
+    if (hold) {
+        _clocks_holders |= holder;
+    } else {
+        _clocks_holders &= ~holder;
+    }
+    bool high = 0 != _clocks_holders;
+    if (high != _clocks_high) {
+        _clocks_set(high);
+    }
+}
+
+
+static void _clocks_notify(clocks_change_t change)
+{
+    for (uint32_t i = 0; i < CLOCKS_NOTIFIERS_MAX; i++) {
+        if (_clocks_notifiers[i]) {
+            _clocks_notifiers[i](change);
+        }
+    }
+}
+
+
+static void _clocks_set(bool high)
+{
+    _clocks_notify(CLOCKS_CHANGE_PRE);
+    if (high) {
+        /* sets flash wait states and rcc_*_frequency too */
+        rcc_clock_setup_in_hsi_out_48mhz();
+    } else {
+        rcc_set_sysclk_source(RCC_HSI);
+        rcc_wait_for_sysclk_status(RCC_HSI);
+        rcc_osc_off(RCC_PLL);
+        /* only lower wait states once no longer running fast */
+        flash_set_ws(FLASH_ACR_LATENCY_000_024MHZ);
+        rcc_ahb_frequency = CLOCKS_LOW_HZ;
+        rcc_apb1_frequency = CLOCKS_LOW_HZ;
+    }
+    _clocks_high = high;
+    _clocks_notify(CLOCKS_CHANGE_POST);
+}
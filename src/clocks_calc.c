@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "clocks_calc.h"
+
+
+/* Kept free of any hardware access so it can be tested on the host */
+
+
+#define CLOCKS_CALC_SYSTICK_RELOAD_MAX      0xFFFFFFUL
+
+#define CLOCKS_CALC_USART_BRR_MIN           16UL
+#define CLOCKS_CALC_USART_BRR_MAX           0xFFFFUL
+
+/* I2C standard mode (100kHz) timings from RM0091, for a 4MHz timing clock */
+#define CLOCKS_CALC_I2C_SM_TIMING_HZ        4000000UL
+#define CLOCKS_CALC_I2C_PRESC_MAX           15UL
+#define CLOCKS_CALC_I2C_SM_SCLL             0x13UL
+#define CLOCKS_CALC_I2C_SM_SCLH             0x0FUL
+#define CLOCKS_CALC_I2C_SM_SDADEL           0x2UL
+#define CLOCKS_CALC_I2C_SM_SCLDEL           0x4UL
+
+
+bool clocks_calc_systick_reload(uint32_t ahb_hz, uint32_t tick_hz, uint32_t* reload)
+{
+    if (!tick_hz || (ahb_hz < tick_hz)) {
+        return false;
+    }
+    uint32_t value = (ahb_hz + tick_hz / 2) / tick_hz - 1;
+    if (CLOCKS_CALC_SYSTICK_RELOAD_MAX < value) {
+        return false;
+    }
+    *reload = value;
+    return true;
+}
+
+
+bool clocks_calc_usart_brr(uint32_t pclk_hz, uint32_t baud, uint32_t* brr)
+{
+    /* 16x oversampling, rounded to nearest */
+    if (!baud) {
+        return false;
+    }
+    uint32_t value = (pclk_hz + baud / 2) / baud;
+    if ((CLOCKS_CALC_USART_BRR_MIN > value) || (CLOCKS_CALC_USART_BRR_MAX < value)) {
+        return false;
+    }
+    uint64_t actual = (uint64_t)value * baud;
+    uint64_t error = (actual > pclk_hz) ? (actual - pclk_hz) : (pclk_hz - actual);
+    if (error * 1000000ULL > actual * CLOCKS_CALC_BAUD_TOLERANCE_PPM) {
+        return false;
+    }
+    *brr = value;
+    return true;
+}
+
+
+bool clocks_calc_i2c_timing_sm(uint32_t i2c_hz, uint32_t* timingr)
+{
+    if (!i2c_hz) {
+        return false;
+    }
+    /* round the prescaler up so the timing clock is never faster than
+     * the timings were worked out for, only slower */
+    uint32_t presc = (i2c_hz + CLOCKS_CALC_I2C_SM_TIMING_HZ - 1) / CLOCKS_CALC_I2C_SM_TIMING_HZ;
+    if (presc) {
+        presc--;
+    }
+    if (CLOCKS_CALC_I2C_PRESC_MAX < presc) {
+        return false;
+    }
+    *timingr = (presc << 28) |
+               (CLOCKS_CALC_I2C_SM_SCLDEL << 20) |
+               (CLOCKS_CALC_I2C_SM_SDADEL << 16) |
+               (CLOCKS_CALC_I2C_SM_SCLH << 8) |
+               CLOCKS_CALC_I2C_SM_SCLL;
+    return true;
+}
@@ -0,0 +1,138 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include "systick.h"
+#include "itf.h"
+#include "events.h"
+
+
+#define EVENTS_QUEUE_SIZE                   16
+#define EVENTS_QUEUE_MASK                   (EVENTS_QUEUE_SIZE - 1)
+#define EVENTS_PER_PACKET                   8
+
+#define EVENTS_BARRIER()                    __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+_Static_assert((EVENTS_QUEUE_SIZE & EVENTS_QUEUE_MASK) == 0, "Event queue size must be a power of two");
+
+
+typedef enum {
+    EVENTS_SLOT_FREE = 0,
+    EVENTS_SLOT_WRITING,
+    EVENTS_SLOT_READY,
+    EVENTS_SLOT_DRAINING,
+} _events_slot_state_t;
+
+
+typedef struct {
+    itf_event_t event;
+    volatile uint8_t state; /* _events_slot_state_t */
+} _events_slot_t;
+
+
+static void _events_drain_finish(uint32_t count, bool sent);
+
+
+static _events_slot_t _events_queue[EVENTS_QUEUE_SIZE] = {0};
+/* Free-running; head is claimed by producers, tail by the consumer */
+static volatile uint32_t _events_head = 0;
+static volatile uint32_t _events_tail = 0;
+static volatile uint32_t _events_dropped = 0;
+static itf_event_t _events_packet[EVENTS_PER_PACKET] = {0};
+
+
+/* Can be called from any ISR or the main loop. Interrupts are only masked
+ * while a slot is claimed (or coalesced into), never while it is filled.
+ * Cortex-M0 has no exclusive load/store so this is as close to lock-free
+ * as the core allows. */
+bool events_post(events_type_t type, uint32_t arg)
+{
+    uint32_t now = get_since_boot_ms();
+    uint32_t primask = cm_mask_interrupts(1);
+    uint32_t head = _events_head;
+    if (head != _events_tail) {
+        _events_slot_t* last = &_events_queue[(head - 1) & EVENTS_QUEUE_MASK];
+        if ((EVENTS_SLOT_READY == last->state) &&
+            (type == last->event.type) &&
+            (arg == last->event.arg) &&
+            (UINT16_MAX > last->event.count)) {
+            /* same as last undrained event, just count it */
+            last->event.count++;
+            last->event.timestamp_ms = now;
+            cm_mask_interrupts(primask);
+            return true;
+        }
+    }
+    if (EVENTS_QUEUE_SIZE <= head - _events_tail) {
+        _events_dropped++;
+        cm_mask_interrupts(primask);
+        return false;
+    }
+    _events_slot_t* slot = &_events_queue[head & EVENTS_QUEUE_MASK];
+    slot->state = EVENTS_SLOT_WRITING;
+    _events_head = head + 1;
+    cm_mask_interrupts(primask);
+
+    slot->event.timestamp_ms = now;
+    slot->event.type = type;
+    slot->event.count = 1;
+    slot->event.arg = arg;
+    EVENTS_BARRIER();
+    slot->state = EVENTS_SLOT_READY;
+    return true;
+}
+
+
+/* Single consumer, main loop only */
+void events_iterate(void)
+{
+    uint32_t count = 0;
+    uint32_t primask = cm_mask_interrupts(1);
+    uint32_t tail = _events_tail;
+    uint32_t head = _events_head;
+    while ((count < EVENTS_PER_PACKET) && (tail + count != head)) {
+        _events_slot_t* slot = &_events_queue[(tail + count) & EVENTS_QUEUE_MASK];
+        if (EVENTS_SLOT_READY != slot->state) {
+            /* still being written, keep order and wait for it */
+            break;
+        }
+        slot->state = EVENTS_SLOT_DRAINING;
+        _events_packet[count] = slot->event;
+        count++;
+    }
+    cm_mask_interrupts(primask);
+
+    if (count) {
+        _events_drain_finish(count, itf_send_events(_events_packet, count));
+    }
+
+    if (_events_dropped) {
+        primask = cm_mask_interrupts(1);
+        uint32_t dropped = _events_dropped;
+        _events_dropped = 0;
+        cm_mask_interrupts(primask);
+        if (!events_post(EVENTS_TYPE_QUEUE_OVERFLOW, dropped)) {
+            /* still full, try again next time (the failed post has
+             * already counted itself as dropped) */
+            primask = cm_mask_interrupts(1);
+            _events_dropped += dropped - 1;
+            cm_mask_interrupts(primask);
+        }
+    }
+}
+
+
+static void _events_drain_finish(uint32_t count, bool sent)
+{
+    uint32_t primask = cm_mask_interrupts(1);
+    uint32_t tail = _events_tail;
+    for (uint32_t i = 0; i < count; i++) {
+        /* failed sends are left in the queue to be retried */
+        _events_queue[(tail + i) & EVENTS_QUEUE_MASK].state = sent ? EVENTS_SLOT_FREE : EVENTS_SLOT_READY;
+    }
+    if (sent) {
+        _events_tail = tail + count;
+    }
+    cm_mask_interrupts(primask);
+}
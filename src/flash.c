@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/cortex.h>
+
+#include "flash.h"
+
+
+#define FLASH_ACTIVE_ADDR               0x08000000UL
+#define FLASH_SLOT_ADDR                 (FLASH_ACTIVE_ADDR + FLASH_SLOT_SIZE)
+
+#define FLASH_RAMFUNC                   __attribute__((section(".ramtext"), noinline, long_call))
+
+
+static void FLASH_RAMFUNC _flash_copy_slot(uint32_t len);
+
+
+bool flash_slot_erase(uint32_t len)
+{
+    if (FLASH_SLOT_SIZE < len) {
+        return false;
+    }
+    bool ok = true;
+    flash_unlock();
+    for (uint32_t offset = 0; offset < len; offset += FLASH_SLOT_PAGE_SIZE) {
+        flash_clear_status_flags();
+        flash_erase_page(FLASH_SLOT_ADDR + offset);
+        if (flash_get_status_flags() & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) {
+            ok = false;
+            break;
+        }
+    }
+    flash_lock();
+    return ok;
+}
+
+
+bool flash_slot_write(uint32_t offset, const uint8_t* data, uint32_t len)
+{
+    if ((offset & 1) || (FLASH_SLOT_SIZE < offset + len)) {
+        /* can only program half words */
+        return false;
+    }
+    flash_unlock();
+    for (uint32_t i = 0; i < len; i += 2) {
+        /* odd trailing byte is padded as erased flash */
+        uint16_t half = data[i] | (((i + 1 < len) ? data[i + 1] : 0xFF) << 8);
+        flash_program_half_word(FLASH_SLOT_ADDR + offset + i, half);
+    }
+    flash_lock();
+    return 0 == memcmp((const void*)(FLASH_SLOT_ADDR + offset), data, len);
+}
+
+
+bool flash_slot_read(uint32_t offset, uint8_t* data, uint32_t len)
+{
+    if (FLASH_SLOT_SIZE < offset + len) {
+        return false;
+    }
+    memcpy(data, (const void*)(FLASH_SLOT_ADDR + offset), len);
+    return true;
+}
+
+
+void flash_slot_apply(uint32_t len)
+{
+    if (FLASH_SLOT_SIZE < len) {
+        return;
+    }
+    cm_disable_interrupts();
+    flash_unlock();
+    _flash_copy_slot(len);
+    /* _flash_copy_slot() never returns */
+    while (1);
+}
+
+
+/* Runs from RAM as it overwrites the firmware it would otherwise be
+ * running from, so can only touch registers and not call anything. */
+static void FLASH_RAMFUNC _flash_copy_slot(uint32_t len)
+{
+    for (uint32_t offset = 0; offset < len; offset += FLASH_SLOT_PAGE_SIZE) {
+        while (FLASH_SR & FLASH_SR_BSY);
+        FLASH_CR |= FLASH_CR_PER;
+        FLASH_AR = FLASH_ACTIVE_ADDR + offset;
+        FLASH_CR |= FLASH_CR_STRT;
+        while (FLASH_SR & FLASH_SR_BSY);
+        FLASH_CR &= ~FLASH_CR_PER;
+    }
+    FLASH_CR |= FLASH_CR_PG;
+    for (uint32_t offset = 0; offset < len; offset += 2) {
+        MMIO16(FLASH_ACTIVE_ADDR + offset) = MMIO16(FLASH_SLOT_ADDR + offset);
+        while (FLASH_SR & FLASH_SR_BSY);
+    }
+    FLASH_CR &= ~FLASH_CR_PG;
+    SCB_AIRCR = SCB_AIRCR_VECTKEY | SCB_AIRCR_SYSRESETREQ;
+    while (1);
+}
@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "crc.h"
+#include "flash.h"
+#include "itf.h"
+#include "fw_update.h"
+
+
+#define FW_UPDATE_VERIFY_CHUNK          64
+
+/* Where an image's vector table may point, see resources/stm32f07xzb.ld */
+#define FW_UPDATE_RAM_ADDR              0x20000000UL
+#define FW_UPDATE_RAM_SIZE              (16UL * 1024UL)
+#define FW_UPDATE_FLASH_ADDR            0x08000000UL
+
+
+static void _fw_update_status(fw_update_result_t result, itf_fw_status_t* status);
+static bool _fw_update_vectors_valid(void);
+
+
+static fw_update_state_t _fw_update_state = FW_UPDATE_STATE_IDLE;
+static uint32_t _fw_update_size = 0;
+static uint32_t _fw_update_crc = 0;
+static uint32_t _fw_update_offset = 0;
+static uint8_t _fw_update_chunk[FW_UPDATE_VERIFY_CHUNK];
+
+
+void fw_update_begin(uint32_t size, uint32_t crc, itf_fw_status_t* status)
+{
+    if ((FW_UPDATE_STATE_IDLE != _fw_update_state) &&
+        (size == _fw_update_size) &&
+        (crc == _fw_update_crc)) {
+        /* same image as before, resume from where it got to */
+        _fw_update_status(FW_UPDATE_RESULT_OK, status);
+        return;
+    }
+    _fw_update_state = FW_UPDATE_STATE_IDLE;
+    if (!size) {
+        _fw_update_status(FW_UPDATE_RESULT_BAD_ARG, status);
+        return;
+    }
+    if (FLASH_SLOT_SIZE < size) {
+        _fw_update_status(FW_UPDATE_RESULT_TOO_BIG, status);
+        return;
+    }
+    /* erase everything up front so blocks only need programming and can
+     * be streamed without stalling on page erases */
+    if (!flash_slot_erase(size)) {
+        _fw_update_status(FW_UPDATE_RESULT_FLASH, status);
+        return;
+    }
+    _fw_update_size = size;
+    _fw_update_crc = crc;
+    _fw_update_offset = 0;
+    _fw_update_state = FW_UPDATE_STATE_RECEIVING;
+    _fw_update_status(FW_UPDATE_RESULT_OK, status);
+}
+
+
+void fw_update_block(uint32_t offset, const uint8_t* data, uint32_t len, uint32_t crc, itf_fw_status_t* status)
+{
+    if (FW_UPDATE_STATE_RECEIVING != _fw_update_state) {
+        _fw_update_status(FW_UPDATE_RESULT_NOT_STARTED, status);
+        return;
+    }
+    if (offset < _fw_update_offset) {
+        /* duplicate of a block already written, just report progress */
+        _fw_update_status(FW_UPDATE_RESULT_OK, status);
+        return;
+    }
+    if (offset != _fw_update_offset) {
+        /* a block was lost, host should go back to the reported offset */
+        _fw_update_status(FW_UPDATE_RESULT_OUT_OF_ORDER, status);
+        return;
+    }
+    if (!len ||
+        (FW_UPDATE_BLOCK_MAX < len) ||
+        (_fw_update_size - offset < len) ||
+        ((len & 1) && (offset + len != _fw_update_size))) {
+        /* only the final block can be an odd length */
+        _fw_update_status(FW_UPDATE_RESULT_BAD_ARG, status);
+        return;
+    }
+    if (crc != crc32((uint8_t*)data, len, CRC32_DEFAULT_START)) {
+        _fw_update_status(FW_UPDATE_RESULT_BAD_CRC, status);
+        return;
+    }
+    if (!flash_slot_write(offset, data, len)) {
+        _fw_update_status(FW_UPDATE_RESULT_FLASH, status);
+        return;
+    }
+    _fw_update_offset += len;
+    _fw_update_status(FW_UPDATE_RESULT_OK, status);
+}
+
+
+void fw_update_end(itf_fw_status_t* status)
+{
+    if (FW_UPDATE_STATE_COMPLETE == _fw_update_state) {
+        _fw_update_status(FW_UPDATE_RESULT_OK, status);
+        return;
+    }
+    if (FW_UPDATE_STATE_RECEIVING != _fw_update_state) {
+        _fw_update_status(FW_UPDATE_RESULT_NOT_STARTED, status);
+        return;
+    }
+    if (_fw_update_offset != _fw_update_size) {
+        _fw_update_status(FW_UPDATE_RESULT_INCOMPLETE, status);
+        return;
+    }
+    uint32_t crc = CRC32_DEFAULT_START;
+    for (uint32_t offset = 0; offset < _fw_update_size; offset += FW_UPDATE_VERIFY_CHUNK) {
+        uint32_t len = _fw_update_size - offset;
+        if (FW_UPDATE_VERIFY_CHUNK < len) {
+            len = FW_UPDATE_VERIFY_CHUNK;
+        }
+        if (!flash_slot_read(offset, _fw_update_chunk, len)) {
+            _fw_update_status(FW_UPDATE_RESULT_FLASH, status);
+            return;
+        }
+        crc = crc32(_fw_update_chunk, len, crc);
+    }
+    if (crc != _fw_update_crc) {
+        /* image is bad, needs to be sent again from the start */
+        _fw_update_state = FW_UPDATE_STATE_IDLE;
+        _fw_update_status(FW_UPDATE_RESULT_IMAGE_CRC, status);
+        return;
+    }
+    if (!_fw_update_vectors_valid()) {
+        /* intact, but applying it would leave nothing that can boot */
+        _fw_update_state = FW_UPDATE_STATE_IDLE;
+        _fw_update_status(FW_UPDATE_RESULT_BAD_IMAGE, status);
+        return;
+    }
+    _fw_update_state = FW_UPDATE_STATE_COMPLETE;
+    _fw_update_status(FW_UPDATE_RESULT_OK, status);
+}
+
+
+bool fw_update_apply(void)
+{
+    if (FW_UPDATE_STATE_COMPLETE != _fw_update_state) {
+        return false;
+    }
+    /* does not return on target */
+    flash_slot_apply(_fw_update_size);
+    _fw_update_state = FW_UPDATE_STATE_IDLE;
+    return true;
+}
+
+
+/* Initial stack pointer must be in RAM and the reset handler a thumb
+ * address within the running firmware's half of flash */
+static bool _fw_update_vectors_valid(void)
+{
+    uint32_t vectors[2];
+    if ((sizeof(vectors) > _fw_update_size) ||
+        !flash_slot_read(0, (uint8_t*)vectors, sizeof(vectors))) {
+        return false;
+    }
+    uint32_t sp = vectors[0];
+    uint32_t reset = vectors[1];
+    return (sp > FW_UPDATE_RAM_ADDR) &&
+           (sp <= FW_UPDATE_RAM_ADDR + FW_UPDATE_RAM_SIZE) &&
+           !(sp & 3) &&
+           (reset & 1) &&
+           (reset >= FW_UPDATE_FLASH_ADDR) &&
+           (reset < FW_UPDATE_FLASH_ADDR + FLASH_SLOT_SIZE);
+}
+
+
+static void _fw_update_status(fw_update_result_t result, itf_fw_status_t* status)
+{
+    status->state = _fw_update_state;
+    status->result = result;
+    status->offset = _fw_update_offset;
+    status->size = _fw_update_size;
+}
@@ -9,12 +9,17 @@
 #include "itf.h"
 #include "pinmap.h"
 #include "systick.h"
+#include "events.h"
+#include "clocks.h"
+#include "clocks_calc.h"
 
 
 #define HTU21D_I2C_ADDR                         0x40
 #define HTU21D_DELAY_CLEAR_MS                   90UL
 #define HTU21D_DELAY_TEMP_MS                    16UL
 #define HTU21D_DELAY_HUMI_MS                    16UL
+#define HTU21D_TRIGGERS_MAX                     4
+#define HTU21D_TRIGGER_ATTEMPTS                 3
 
 #define HTU21D_TRANSFER(_w, _wn, _r, _rn)       i2c_transfer7_timeout(I2C_HTU21D_PERIPH, HTU21D_I2C_ADDR, _w, _wn, _r, _rn, I2C_DEFAULT_TIMEOUT_MS)
 
@@ -34,6 +39,19 @@ static bool _htu21d_command(const _htu21d_command_t command);
 static bool _htu21d_read(uint16_t* data);
 static int32_t _htu21d_conv_temperature(uint16_t s_temp);
 static int32_t _htu21d_conv_humidity(uint16_t s_humi);
+static void _htu21d_set_timing(void);
+static void _htu21d_clocks_notifier(clocks_change_t change);
+static void _htu21d_triggers_done(itf_measurements_t* measurements);
+static void _htu21d_triggers_failed(void);
+
+
+/* Request IDs of triggers in the conversion running now, followed by those
+ * waiting for the next one */
+static uint16_t _htu21d_triggers[HTU21D_TRIGGERS_MAX] = {0};
+static uint32_t _htu21d_triggers_active = 0;
+static uint32_t _htu21d_triggers_pending = 0;
+/* Conversions failed in a row, while non-zero triggers wait as normal */
+static uint32_t _htu21d_failures = 0;
 
 
 void htu21d_init(void)
@@ -52,18 +70,29 @@ void htu21d_init(void)
     //configure ANFOFF DNF[3:0] in CR1
     i2c_enable_analog_filter(I2C_HTU21D_PERIPH);
     i2c_set_digital_filter(I2C_HTU21D_PERIPH, 0);
-    /* HSI is at 8Mhz */
-    i2c_set_speed(I2C_HTU21D_PERIPH, i2c_speed_sm_100k, 8);
+    _htu21d_set_timing();
     //configure No-Stretch CR1 (only relevant in slave mode)
     i2c_enable_stretching(I2C_HTU21D_PERIPH);
     //addressing mode
     i2c_set_7bit_addr_mode(I2C_HTU21D_PERIPH);
     i2c_peripheral_enable(I2C_HTU21D_PERIPH);
 
+    clocks_register_notifier(_htu21d_clocks_notifier);
+
     _htu21d_command(HTU21D_COMMAND_SOFT_RESET);
 }
 
 
+bool htu21d_trigger(uint16_t request_id)
+{
+    if (HTU21D_TRIGGERS_MAX <= _htu21d_triggers_active + _htu21d_triggers_pending) {
+        return false;
+    }
+    _htu21d_triggers[_htu21d_triggers_active + _htu21d_triggers_pending++] = request_id;
+    return true;
+}
+
+
 void htu21d_iterate(void)
 {
     static itf_measurements_t _measurements = {0};
@@ -74,16 +103,25 @@ void htu21d_iterate(void)
         HTU21D_STATE_READ_TEMP,
         HTU21D_STATE_READ_HUMI,
     } _state = HTU21D_STATE_CLEAR;
-    if (since_boot_delta(get_since_boot_ms(), _last_measurement_time) <= _delay_ms) {
-        /* not enough time has passed */
+    bool triggered = (HTU21D_STATE_CLEAR == _state) && _htu21d_triggers_pending && !_htu21d_failures;
+    if (!triggered && (since_boot_delta(get_since_boot_ms(), _last_measurement_time) <= _delay_ms)) {
+        /* not enough time has passed, and no one is waiting (or the
+         * sensor is failing, so do not hammer it) */
         return;
     }
     switch (_state) {
         case HTU21D_STATE_CLEAR:
             if (_htu21d_command(HTU21D_COMMAND_HOLD_TRIG_TEMP_MEAS)) {
-                /* succeeded sending command */
+                /* succeeded sending command, any triggers so far will be
+                 * answered by this conversion */
+                _htu21d_triggers_active += _htu21d_triggers_pending;
+                _htu21d_triggers_pending = 0;
                 _state = HTU21D_STATE_READ_TEMP;
                 _delay_ms = HTU21D_DELAY_TEMP_MS;
+            } else {
+                /* most likely no ACK, sensor missing */
+                events_post(EVENTS_TYPE_SENSOR_ERROR, _state);
+                _htu21d_triggers_failed();
             }
             break;
         case HTU21D_STATE_READ_TEMP: {
@@ -94,6 +132,8 @@ void htu21d_iterate(void)
                 _measurements.temperature = _htu21d_conv_temperature(temp16);
                 _delay_ms = HTU21D_DELAY_HUMI_MS;
             } else {
+                events_post(EVENTS_TYPE_SENSOR_ERROR, _state);
+                _htu21d_triggers_failed();
                 _state = HTU21D_STATE_CLEAR;
                 _delay_ms = HTU21D_DELAY_CLEAR_MS;
             }
@@ -107,6 +147,10 @@ void htu21d_iterate(void)
                  * with both */
                 _measurements.relative_humdity = _htu21d_conv_humidity(humi16);
                 itf_send_measurements(&_measurements);
+                _htu21d_triggers_done(&_measurements);
+            } else {
+                events_post(EVENTS_TYPE_SENSOR_ERROR, _state);
+                _htu21d_triggers_failed();
             }
             _state = HTU21D_STATE_CLEAR;
             _delay_ms = HTU21D_DELAY_CLEAR_MS;
@@ -153,3 +197,57 @@ static int32_t _htu21d_conv_humidity(uint16_t s_humi)
 {
     return 12500L * s_humi / (1 << 16) - 600L;
 }
+
+
+static void _htu21d_set_timing(void)
+{
+    /* I2C kernel clock is HSI, so this only changes if that does */
+    uint32_t timingr = 0;
+    if (!clocks_calc_i2c_timing_sm(rcc_get_i2c_clk_freq(I2C_HTU21D_PERIPH), &timingr)) {
+        return;
+    }
+    I2C_TIMINGR(I2C_HTU21D_PERIPH) = timingr;
+}
+
+
+static void _htu21d_clocks_notifier(clocks_change_t change)
+{
+    /* transfers are blocking so one can not be in flight here */
+    if (CLOCKS_CHANGE_POST == change) {
+        /* TIMINGR can only be written while the peripheral is disabled */
+        i2c_peripheral_disable(I2C_HTU21D_PERIPH);
+        _htu21d_set_timing();
+        i2c_peripheral_enable(I2C_HTU21D_PERIPH);
+    }
+}
+
+
+static void _htu21d_triggers_done(itf_measurements_t* measurements)
+{
+    for (uint32_t i = 0; i < _htu21d_triggers_active; i++) {
+        itf_send_sample(_htu21d_triggers[i], measurements);
+    }
+    /* move triggers that came in during the conversion to the front */
+    for (uint32_t i = 0; i < _htu21d_triggers_pending; i++) {
+        _htu21d_triggers[i] = _htu21d_triggers[_htu21d_triggers_active + i];
+    }
+    _htu21d_triggers_active = 0;
+    _htu21d_failures = 0;
+}
+
+
+static void _htu21d_triggers_failed(void)
+{
+    /* retry triggers with the next conversion */
+    _htu21d_triggers_pending += _htu21d_triggers_active;
+    _htu21d_triggers_active = 0;
+    if (++_htu21d_failures < HTU21D_TRIGGER_ATTEMPTS) {
+        return;
+    }
+    /* give up on everything waiting so the slots are freed */
+    for (uint32_t i = 0; i < _htu21d_triggers_pending; i++) {
+        itf_send_sample_failed(_htu21d_triggers[i]);
+    }
+    _htu21d_triggers_pending = 0;
+    _htu21d_failures = 0;
+}
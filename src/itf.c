@@ -5,11 +5,25 @@
 #include "uart_rings.h"
 #include "crc.h"
 #include "system.h"
+#include "systick.h"
+#include "util.h"
+#include "events.h"
+#include "fw_update.h"
+#include "clocks.h"
+#include "htu21d.h"
 #include "itf.h"
 
 
 #define ITF_PACKET_BUF_SIZE                 128
-#define ITF_PACKET_VERSION                  1
+#define ITF_PACKET_VERSION                  2
+#define ITF_PACKET_NO_REQUEST               0
+#define ITF_PACKET_FLAG_BOOT                0x01
+/* Packets flagged as being soon after boot, so the host can tell a reset
+ * from a wrap of the sequence number even if it misses some of them */
+#define ITF_PACKET_BOOT_SEQS                256
+/* A host that stops mid update gives up the high clock after this, the
+ * update itself is kept and can be resumed */
+#define ITF_FW_IDLE_TIMEOUT_MS              10000
 
 
 typedef enum {
@@ -17,51 +31,135 @@ typedef enum {
     ITF_PACKET_OUT_TYPE_MEASUREMENTS = 2,
     ITF_PACKET_OUT_TYPE_HEALTH = 3,
     ITF_PACKET_OUT_TYPE_EVENT = 4,
+    ITF_PACKET_OUT_TYPE_FW_STATUS = 5,
+    ITF_PACKET_OUT_TYPE_PROFILE = 6,
+    ITF_PACKET_OUT_TYPE_SAMPLE = 7,
+    ITF_PACKET_OUT_TYPE_ACK = 8,
+    ITF_PACKET_OUT_TYPE_NACK = 9,
 } _itf_packet_out_type_t;
 
 
 typedef enum {
     ITF_PACKET_IN_TYPE_NOP = 1,
     ITF_PACKET_IN_TYPE_RESET = 2,
+    ITF_PACKET_IN_TYPE_FW_BEGIN = 3,
+    ITF_PACKET_IN_TYPE_FW_BLOCK = 4,
+    ITF_PACKET_IN_TYPE_FW_END = 5,
+    ITF_PACKET_IN_TYPE_TRIGGER = 6,
 } _itf_packet_in_type_t;
 
 
+typedef enum {
+    ITF_NACK_REASON_NONE = 0,
+    ITF_NACK_REASON_UNKNOWN_TYPE = 1,
+    ITF_NACK_REASON_BAD_LENGTH = 2,
+    ITF_NACK_REASON_BUSY = 3,
+    ITF_NACK_REASON_SENSOR = 4,
+} _itf_nack_reason_t;
+
+
 typedef struct {
     uint8_t version;
     uint8_t type; /* _itf_packet_out_type_t / _itf_packet_in_type_t */
+    uint8_t flags; /* ITF_PACKET_FLAG_*, none from the host */
+    uint16_t seq; /* per direction, incremented for every packet */
+    uint16_t request_id; /* command being answered, or ITF_PACKET_NO_REQUEST */
 } __attribute__((packed)) _itf_packet_header_t;
 
 
-static bool _itf_send_packet(_itf_packet_out_type_t type, uint8_t* payload, uint32_t len);
-static uint32_t _itf_process_packet(uint8_t* buf, uint32_t len);
+typedef struct {
+    uint8_t reason; /* _itf_nack_reason_t */
+} __attribute__((packed)) _itf_nack_t;
+
+
+static bool _itf_send_packet(_itf_packet_out_type_t type, uint16_t request_id, uint8_t* payload, uint32_t len);
+static void _itf_process_packet(uint8_t* buf, uint32_t len);
+static _itf_nack_reason_t _itf_process_fw(uint8_t type, uint8_t* payload, uint32_t len);
 
 
 static uint8_t _itf_packet_buf[ITF_PACKET_BUF_SIZE] = {0};
+static uint8_t _itf_rx_buf[ITF_PACKET_BUF_SIZE] = {0};
+static uint32_t _itf_rx_len = 0;
+static uint16_t _itf_tx_seq = 0;
+static bool _itf_tx_booting = true;
+static bool _itf_fw_holding = false;
+static uint32_t _itf_fw_last_ms = 0;
 
 
 bool itf_send_nop(void)
 {
-    return _itf_send_packet(ITF_PACKET_OUT_TYPE_NOP, NULL, 0);
+    return _itf_send_packet(ITF_PACKET_OUT_TYPE_NOP, ITF_PACKET_NO_REQUEST, NULL, 0);
 }
 
 
 bool itf_send_measurements(itf_measurements_t* measurements)
 {
-    return _itf_send_packet(ITF_PACKET_OUT_TYPE_MEASUREMENTS, (uint8_t*)measurements, sizeof(itf_measurements_t));
+    return _itf_send_packet(ITF_PACKET_OUT_TYPE_MEASUREMENTS, ITF_PACKET_NO_REQUEST, (uint8_t*)measurements, sizeof(itf_measurements_t));
+}
+
+
+bool itf_send_sample(uint16_t request_id, itf_measurements_t* measurements)
+{
+    return _itf_send_packet(ITF_PACKET_OUT_TYPE_SAMPLE, request_id, (uint8_t*)measurements, sizeof(itf_measurements_t));
+}
+
+
+/* Acked TRIGGERs whose conversion never worked get a late NACK instead of
+ * a SAMPLE */
+bool itf_send_sample_failed(uint16_t request_id)
+{
+    _itf_nack_t nack = { .reason = ITF_NACK_REASON_SENSOR };
+    return _itf_send_packet(ITF_PACKET_OUT_TYPE_NACK, request_id, (uint8_t*)&nack, sizeof(_itf_nack_t));
+}
+
+
+bool itf_send_events(itf_event_t* events, uint32_t count)
+{
+    return _itf_send_packet(ITF_PACKET_OUT_TYPE_EVENT, ITF_PACKET_NO_REQUEST, (uint8_t*)events, count * sizeof(itf_event_t));
+}
+
+
+bool itf_send_fw_status(itf_fw_status_t* status)
+{
+    return _itf_send_packet(ITF_PACKET_OUT_TYPE_FW_STATUS, ITF_PACKET_NO_REQUEST, (uint8_t*)status, sizeof(itf_fw_status_t));
+}
+
+
+/* `count` entries must directly follow the profile header */
+bool itf_send_profile(itf_profile_t* profile, uint32_t count)
+{
+    return _itf_send_packet(ITF_PACKET_OUT_TYPE_PROFILE, ITF_PACKET_NO_REQUEST, (uint8_t*)profile, sizeof(itf_profile_t) + count * sizeof(itf_profile_entry_t));
 }
 
 
 void itf_iterate(void)
 {
+    if (_itf_fw_holding &&
+        (since_boot_delta(get_since_boot_ms(), _itf_fw_last_ms) > ITF_FW_IDLE_TIMEOUT_MS)) {
+        _itf_fw_holding = false;
+        clocks_hold_high(CLOCKS_HOLDER_FW_UPDATE, false);
+    }
     uint32_t len = 1;
     while (len) {
-        len = uart_rings_in_drain(_itf_packet_buf, ITF_PACKET_BUF_SIZE);
-        len -= _itf_process_packet(_itf_packet_buf, len);
+        /* frames can arrive split across iterations, so collect until
+         * the delimiter is seen */
+        len = uart_rings_in_drain(&_itf_rx_buf[_itf_rx_len], ITF_PACKET_BUF_SIZE - _itf_rx_len);
+        _itf_rx_len += len;
+        if (!_itf_rx_len) {
+            break;
+        }
+        if (COBS_FRAME_DELIMITER == _itf_rx_buf[_itf_rx_len - 1]) {
+            _itf_process_packet(_itf_rx_buf, _itf_rx_len);
+            _itf_rx_len = 0;
+        } else if (ITF_PACKET_BUF_SIZE == _itf_rx_len) {
+            /* too long to be a valid frame, toss it */
+            _itf_rx_len = 0;
+        }
     }
 }
 
 
-static bool _itf_send_packet(_itf_packet_out_type_t type, uint8_t* payload, uint32_t len)
+static bool _itf_send_packet(_itf_packet_out_type_t type, uint16_t request_id, uint8_t* payload, uint32_t len)
 {
     if (ITF_PACKET_BUF_SIZE <= len) {
         /* <= not < as using COBS, final packet will always be 1 byte
@@ -77,6 +175,14 @@ static bool _itf_send_packet(_itf_packet_out_type_t type, uint8_t* payload, uint
     _itf_packet_header_t header;
     header.version = ITF_PACKET_VERSION;
     header.type = type;
+    /* taken even if the packet is dropped below, the gap is how the host
+     * counts lost packets */
+    header.flags = _itf_tx_booting ? ITF_PACKET_FLAG_BOOT : 0;
+    header.seq = _itf_tx_seq++;
+    if (ITF_PACKET_BOOT_SEQS <= _itf_tx_seq) {
+        _itf_tx_booting = false;
+    }
+    header.request_id = request_id;
     if (COBS_RET_SUCCESS != cobs_encode_inc(&cobs_ctx, &header, sizeof(_itf_packet_header_t))) {
         return false;
     }
@@ -96,7 +202,7 @@ static bool _itf_send_packet(_itf_packet_out_type_t type, uint8_t* payload, uint
 }
 
 
-static uint32_t _itf_process_packet(uint8_t* buf, uint32_t len)
+static void _itf_process_packet(uint8_t* buf, uint32_t len)
 {
     static uint8_t packet[ITF_PACKET_BUF_SIZE];
     cobs_decode_inc_ctx_t cobs_ctx = {0};
@@ -107,42 +213,116 @@ static uint32_t _itf_process_packet(uint8_t* buf, uint32_t len)
     cobs_args.enc_src_max = len;
     if (COBS_RET_SUCCESS != cobs_decode_inc_begin(&cobs_ctx)) {
         /* unable init cobs, probably bad pointer? */
-        return len;
+        return;
     }
     size_t out_enc_src_len = 0;
     size_t out_dec_dst_len = 0;
     bool out_decode_complete = false;
     if (COBS_RET_SUCCESS != cobs_decode_inc(&cobs_ctx, &cobs_args, &out_enc_src_len, &out_dec_dst_len, &out_decode_complete)) {
         /* fail to decode, toss packet */
-        return len;
+        return;
     }
     if (!out_decode_complete) {
         /* not complete, for whatever reason, toss packet */
-        return len;
+        return;
     }
-    if (sizeof(_itf_packet_header_t) > out_dec_dst_len) {
+    if (sizeof(_itf_packet_header_t) + sizeof(uint32_t) > out_dec_dst_len) {
         /* packet too small, assume broken */
-        return len;
+        return;
     }
     if (crc32(packet, out_dec_dst_len, CRC32_DEFAULT_START)) {
         /* CRC32 of whole packet (including embedded CRC) will be 0 if
          * correct, if incorrect, throw away packet */
-        return out_enc_src_len;
+        events_post(EVENTS_TYPE_ITF_BAD_PACKET, EVENTS_BAD_PACKET_CRC);
+        return;
     }
     _itf_packet_header_t* header = (_itf_packet_header_t*)packet;
     if (ITF_PACKET_VERSION != header->version) {
         /* wrong packet version */
-        return out_enc_src_len;
+        events_post(EVENTS_TYPE_ITF_BAD_PACKET, EVENTS_BAD_PACKET_VERSION);
+        return;
     }
+    uint8_t* payload = &packet[sizeof(_itf_packet_header_t)];
+    uint32_t payload_len = out_dec_dst_len - sizeof(_itf_packet_header_t) - sizeof(uint32_t);
+    _itf_nack_reason_t reason = ITF_NACK_REASON_NONE;
     switch (header->type) {
         case ITF_PACKET_IN_TYPE_NOP:
             break;
         case ITF_PACKET_IN_TYPE_RESET:
-            system_reset();
+            /* can not be acked, the device is gone before it is sent */
+            if (!fw_update_apply()) {
+                /* no new firmware to apply */
+                system_reset();
+            }
+            break;
+        case ITF_PACKET_IN_TYPE_FW_BEGIN:
+        case ITF_PACKET_IN_TYPE_FW_BLOCK:
+        case ITF_PACKET_IN_TYPE_FW_END:
+            reason = _itf_process_fw(header->type, payload, payload_len);
+            break;
+        case ITF_PACKET_IN_TYPE_TRIGGER:
+            if (payload_len) {
+                reason = ITF_NACK_REASON_BAD_LENGTH;
+            } else if (!htu21d_trigger(header->request_id)) {
+                reason = ITF_NACK_REASON_BUSY;
+            }
+            /* else answered with a SAMPLE once a fresh conversion is done */
             break;
         default:
             /* Unknown packet type */
+            events_post(EVENTS_TYPE_ITF_BAD_PACKET, EVENTS_BAD_PACKET_TYPE);
+            reason = ITF_NACK_REASON_UNKNOWN_TYPE;
             break;
     }
-    return out_enc_src_len;
+    if (ITF_PACKET_NO_REQUEST == header->request_id) {
+        /* host does not want to know */
+        return;
+    }
+    if (ITF_NACK_REASON_NONE == reason) {
+        _itf_send_packet(ITF_PACKET_OUT_TYPE_ACK, header->request_id, NULL, 0);
+    } else {
+        _itf_nack_t nack = { .reason = reason };
+        _itf_send_packet(ITF_PACKET_OUT_TYPE_NACK, header->request_id, (uint8_t*)&nack, sizeof(_itf_nack_t));
+    }
+}
+
+
+static _itf_nack_reason_t _itf_process_fw(uint8_t type, uint8_t* payload, uint32_t len)
+{
+    static itf_fw_status_t status;
+    switch (type) {
+        case ITF_PACKET_IN_TYPE_FW_BEGIN: {
+            if (sizeof(itf_fw_begin_t) != len) {
+                return ITF_NACK_REASON_BAD_LENGTH;
+            }
+            itf_fw_begin_t* begin = (itf_fw_begin_t*)payload;
+            fw_update_begin(begin->size, begin->crc, &status);
+            break;
+        }
+        case ITF_PACKET_IN_TYPE_FW_BLOCK: {
+            if (sizeof(itf_fw_block_t) > len) {
+                return ITF_NACK_REASON_BAD_LENGTH;
+            }
+            itf_fw_block_t* block = (itf_fw_block_t*)payload;
+            fw_update_block(block->offset,
+                            &payload[sizeof(itf_fw_block_t)],
+                            len - sizeof(itf_fw_block_t),
+                            block->crc,
+                            &status);
+            break;
+        }
+        case ITF_PACKET_IN_TYPE_FW_END:
+            fw_update_end(&status);
+            break;
+        default:
+            return ITF_NACK_REASON_UNKNOWN_TYPE;
+    }
+    /* run fast while receiving to keep up with the link */
+    _itf_fw_holding = FW_UPDATE_STATE_RECEIVING == status.state;
+    _itf_fw_last_ms = get_since_boot_ms();
+    clocks_hold_high(CLOCKS_HOLDER_FW_UPDATE, _itf_fw_holding);
+    /* every command gets a status back, which acts as the ack for the
+     * host's send window */
+    itf_send_fw_status(&status);
+    return ITF_NACK_REASON_NONE;
 }
@@ -7,6 +7,9 @@
 #include "uarts.h"
 #include "itf.h"
 #include "htu21d.h"
+#include "events.h"
+#include "clocks.h"
+#include "profiler.h"
 
 
 #define FLASHING_DELAY_MS        1000
@@ -14,6 +17,7 @@
 
 int main(void)
 {
+    clocks_init();
     systick_init();
 
     gpio_mode_setup(LED_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, LED_PIN);
@@ -21,6 +25,7 @@ int main(void)
 
     uarts_init();
     htu21d_init();
+    profiler_init();
 
     uint32_t prev_now = 0;
     while(1) {
@@ -28,7 +33,10 @@ int main(void)
         while(time_passed < FLASHING_DELAY_MS) {
             time_passed = since_boot_delta(get_since_boot_ms(), prev_now);
             itf_iterate();
+            uarts_iterate();
             htu21d_iterate();
+            events_iterate();
+            profiler_iterate();
         }
 
         prev_now = get_since_boot_ms();
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/cortex.h>
+
+#include "pinmap.h"
+#include "util.h"
+#include "systick.h"
+#include "clocks.h"
+#include "itf.h"
+#include "profiler.h"
+
+
+/* Firmware is linked into the lower 64k of flash */
+#define PROFILER_BASE                       0x08000000UL
+#define PROFILER_SIZE                       (64UL * 1024UL)
+#define PROFILER_SHIFT                      6
+#define PROFILER_BUCKETS                    (PROFILER_SIZE >> PROFILER_SHIFT)
+#define PROFILER_IDLE                       (PROFILER_BUCKETS + 1)
+
+/* Not a multiple of the 1ms SysTick to avoid sampling in step with it */
+#define PROFILER_TIM_HZ                     1000000UL
+#define PROFILER_TIM_PERIOD                 1009
+
+#define PROFILER_REPORT_PERIOD_MS           5000
+#define PROFILER_ENTRIES_PER_PACKET         24
+
+/* Stacked exception frame is r0-r3, r12, lr, pc, xPSR */
+#define PROFILER_FRAME_PC                   6
+
+
+typedef struct {
+    itf_profile_t header;
+    itf_profile_entry_t entries[PROFILER_ENTRIES_PER_PACKET];
+} __attribute__((packed)) _profiler_packet_t;
+
+
+void _profiler_sample(uint32_t* frame);
+static void _profiler_set_timing(void);
+static void _profiler_clocks_notifier(clocks_change_t change);
+static uint16_t _profiler_take(uint32_t bucket);
+static void _profiler_give_back(uint32_t count);
+
+
+static volatile uint16_t _profiler_counts[PROFILER_BUCKETS] = {0};
+static volatile uint16_t _profiler_other = 0;
+static _profiler_packet_t _profiler_packet = {0};
+/* Bucket the report has got to, PROFILER_BUCKETS being "other" */
+static uint32_t _profiler_cursor = PROFILER_IDLE;
+
+
+void profiler_init(void)
+{
+    rcc_periph_clock_enable(PROFILER_TIM_RCC);
+    rcc_periph_reset_pulse(PROFILER_TIM_RST);
+    _profiler_set_timing();
+    timer_enable_irq(PROFILER_TIM, TIM_DIER_UIE);
+    nvic_set_priority(PROFILER_TIM_IRQ, IRQ_PRIORITY_PROFILER);
+    nvic_enable_irq(PROFILER_TIM_IRQ);
+    timer_enable_counter(PROFILER_TIM);
+    clocks_register_notifier(_profiler_clocks_notifier);
+}
+
+
+void profiler_iterate(void)
+{
+    static uint32_t _last_report_time = 0UL;
+    if (PROFILER_IDLE == _profiler_cursor) {
+        if (since_boot_delta(get_since_boot_ms(), _last_report_time) <= PROFILER_REPORT_PERIOD_MS) {
+            return;
+        }
+        _last_report_time = get_since_boot_ms();
+        _profiler_cursor = 0;
+        _profiler_packet.header.snapshot++;
+    }
+    /* one packet per iteration, buckets are emptied as they are taken so
+     * samples carry on being collected while reporting */
+    uint32_t start = _profiler_cursor;
+    uint32_t count = 0;
+    while ((count < PROFILER_ENTRIES_PER_PACKET) && (PROFILER_IDLE != _profiler_cursor)) {
+        uint32_t bucket = _profiler_cursor++;
+        uint16_t samples = _profiler_take(bucket);
+        if (samples) {
+            itf_profile_entry_t* entry = &_profiler_packet.entries[count++];
+            entry->bucket = (PROFILER_BUCKETS == bucket) ? ITF_PROFILE_BUCKET_OTHER : bucket;
+            entry->count = samples;
+        }
+    }
+    _profiler_packet.header.base = PROFILER_BASE;
+    _profiler_packet.header.shift = PROFILER_SHIFT;
+    _profiler_packet.header.last = PROFILER_IDLE == _profiler_cursor;
+    if (!itf_send_profile(&_profiler_packet.header, count)) {
+        /* out ring full, retry this packet next time rather than drop
+         * the snapshot as its earlier packets are already sent */
+        _profiler_give_back(count);
+        _profiler_cursor = start;
+    }
+}
+
+
+/* Naked so the exception frame is where the hardware put it. Nothing
+ * runs on the process stack, so the frame is always on MSP. */
+void __attribute__((naked)) tim14_isr(void)
+{
+    __asm__ volatile(
+        "mrs r0, msp\n"
+        "ldr r1, =_profiler_sample\n"
+        "bx r1\n"
+    );
+}
+
+
+void _profiler_sample(uint32_t* frame)
+{
+    timer_clear_flag(PROFILER_TIM, TIM_SR_UIF);
+    uint32_t offset = frame[PROFILER_FRAME_PC] - PROFILER_BASE;
+    volatile uint16_t* count = &_profiler_other;
+    if (PROFILER_SIZE > offset) {
+        count = &_profiler_counts[offset >> PROFILER_SHIFT];
+    }
+    if (UINT16_MAX > *count) {
+        (*count)++;
+    }
+}
+
+
+static void _profiler_set_timing(void)
+{
+    /* timer is clocked from APB1 as it is not divided */
+    timer_set_prescaler(PROFILER_TIM, rcc_apb1_frequency / PROFILER_TIM_HZ - 1);
+    timer_set_period(PROFILER_TIM, PROFILER_TIM_PERIOD);
+}
+
+
+static void _profiler_clocks_notifier(clocks_change_t change)
+{
+    if (CLOCKS_CHANGE_POST == change) {
+        _profiler_set_timing();
+    }
+}
+
+
+static uint16_t _profiler_take(uint32_t bucket)
+{
+    volatile uint16_t* count = (PROFILER_BUCKETS == bucket) ? &_profiler_other : &_profiler_counts[bucket];
+    uint32_t primask = cm_mask_interrupts(1);
+    uint16_t value = *count;
+    *count = 0;
+    cm_mask_interrupts(primask);
+    return value;
+}
+
+
+static void _profiler_give_back(uint32_t count)
+{
+    uint32_t primask = cm_mask_interrupts(1);
+    for (uint32_t i = 0; i < count; i++) {
+        itf_profile_entry_t* entry = &_profiler_packet.entries[i];
+        volatile uint16_t* samples = (ITF_PROFILE_BUCKET_OTHER == entry->bucket) ? &_profiler_other : &_profiler_counts[entry->bucket];
+        uint32_t sum = *samples + entry->count;
+        *samples = (UINT16_MAX < sum) ? UINT16_MAX : sum;
+    }
+    cm_mask_interrupts(primask);
+}
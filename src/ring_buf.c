@@ -1,25 +1,52 @@
 #include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "ring_buf.h"
 
 
+/* Producer and consumer only ever share a core (ISR vs main loop), so a
+ * compiler barrier is enough to keep buffer accesses on the correct side
+ * of the index update. */
+#define RING_BUF_BARRIER()          __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+
 static uint32_t _ring_buf_peek(ring_buf_t* ring, uint8_t* data, uint32_t count, volatile uint32_t* end_pos);
 
 
 uint32_t ring_buf_write(ring_buf_t* ring, uint8_t* data, uint32_t count)
 {
-    uint32_t i = 0;
-    for (; i < count; i++) {
-        uint32_t new_pos = (ring->w_pos + 1) % ring->size;
-        if (new_pos == ring->r_pos) {
-            /* No more space */
-            break;
-        }
-        ring->buf[new_pos] = data[i];
-        ring->w_pos = new_pos;
+    uint32_t w_pos = ring->w_pos;
+    uint32_t space = ring_buf_space(ring);
+    if (count > space) {
+        count = space;
     }
-    return i;
+    uint32_t start = w_pos & ring->mask;
+    uint32_t first = ring->mask + 1 - start;
+    if (first > count) {
+        first = count;
+    }
+    memcpy((uint8_t*)&ring->buf[start], data, first);
+    memcpy((uint8_t*)ring->buf, &data[first], count - first);
+    RING_BUF_BARRIER();
+    ring->w_pos = w_pos + count;
+    return count;
+}
+
+
+/* For producers that only ever add one byte, such as a receive interrupt,
+ * without the split and memcpy calls of ring_buf_write() */
+bool ring_buf_write_byte(ring_buf_t* ring, uint8_t c)
+{
+    uint32_t w_pos = ring->w_pos;
+    if (!ring_buf_space(ring)) {
+        return false;
+    }
+    ring->buf[w_pos & ring->mask] = c;
+    RING_BUF_BARRIER();
+    ring->w_pos = w_pos + 1;
+    return true;
 }
 
 
@@ -37,42 +64,57 @@ uint32_t ring_buf_read(ring_buf_t* ring, uint8_t* data, uint32_t count)
 
 uint32_t ring_buf_read_until(ring_buf_t* ring, uint8_t* data, uint32_t count, uint8_t until)
 {
+    uint32_t r_pos = ring->r_pos;
+    uint32_t used = ring_buf_used(ring);
+    if (count > used) {
+        count = used;
+    }
+    RING_BUF_BARRIER();
     uint32_t i = 0;
-    for (; i < count; i++) {
-        uint32_t new_pos = (ring->r_pos + 1) % ring->size;
-        uint8_t c = ring->buf[new_pos];
-        data[i] = c;
-        ring->r_pos = new_pos;
+    while (i < count) {
+        uint8_t c = ring->buf[(r_pos + i) & ring->mask];
+        data[i++] = c;
         if (c == until) {
-            i++;
-            break;
-        }
-        if (new_pos == ring->w_pos) {
-            /* No more space */
-            i++;
             break;
         }
     }
+    RING_BUF_BARRIER();
+    ring->r_pos = r_pos + i;
     return i;
 }
 
 
+uint32_t ring_buf_used(ring_buf_t* ring)
+{
+    /* Free-running indices, unsigned wrap gives the right answer */
+    return ring->w_pos - ring->r_pos;
+}
+
+
+uint32_t ring_buf_space(ring_buf_t* ring)
+{
+    return ring->mask + 1 - ring_buf_used(ring);
+}
+
+
 static uint32_t _ring_buf_peek(ring_buf_t* ring, uint8_t* data, uint32_t count, volatile uint32_t* end_pos)
 {
     uint32_t r_pos = ring->r_pos;
-    uint32_t i = 0;
-    for (; i < count; i++) {
-        uint32_t new_pos = (r_pos + 1) % ring->size;
-        data[i] = ring->buf[new_pos];
-        r_pos = new_pos;
-        if (new_pos == ring->w_pos) {
-            /* No more space */
-            i++;
-            break;
-        }
+    uint32_t used = ring_buf_used(ring);
+    if (count > used) {
+        count = used;
+    }
+    RING_BUF_BARRIER();
+    uint32_t start = r_pos & ring->mask;
+    uint32_t first = ring->mask + 1 - start;
+    if (first > count) {
+        first = count;
     }
+    memcpy(data, (uint8_t*)&ring->buf[start], first);
+    memcpy(&data[first], (uint8_t*)ring->buf, count - first);
     if (end_pos) {
-        *end_pos = r_pos;
+        RING_BUF_BARRIER();
+        *end_pos = r_pos + count;
     }
-    return i;
+    return count;
 }
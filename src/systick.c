@@ -1,6 +1,18 @@
 #include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/rcc.h>
 
+#include "pinmap.h"
+#include "clocks.h"
+#include "clocks_calc.h"
+
+
+#define SYSTICK_HZ              1000
+
+
+static void _systick_clocks_notifier(clocks_change_t change);
+static void _systick_configure(void);
+
 
 static uint32_t _systick_since_boot_ms = 0;
 
@@ -13,9 +25,11 @@ void __attribute__((interrupt)) sys_tick_handler(void)
 
 void systick_init(void)
 {
-    systick_set_frequency(1000, rcc_ahb_frequency);
+    _systick_configure();
+    nvic_set_priority(NVIC_SYSTICK_IRQ, IRQ_PRIORITY_DEFAULT);
     systick_counter_enable();
     systick_interrupt_enable();
+    clocks_register_notifier(_systick_clocks_notifier);
 }
 
 
@@ -23,3 +37,40 @@ uint32_t get_since_boot_ms(void)
 {
     return _systick_since_boot_ms;
 }
+
+
+/* SysTick counts AHB cycles down from the reload value, the M0 has no DWT
+ * cycle counter so this times anything shorter than a tick */
+uint32_t systick_cycles_now(void)
+{
+    return systick_get_value();
+}
+
+
+uint32_t systick_cycles_since(uint32_t start)
+{
+    uint32_t now = systick_get_value();
+    if (now > start) {
+        start += systick_get_reload() + 1;
+    }
+    return start - now;
+}
+
+
+static void _systick_clocks_notifier(clocks_change_t change)
+{
+    if (CLOCKS_CHANGE_POST == change) {
+        _systick_configure();
+    }
+}
+
+
+static void _systick_configure(void)
+{
+    uint32_t reload = 0;
+    if (!clocks_calc_systick_reload(rcc_ahb_frequency, SYSTICK_HZ, &reload)) {
+        return;
+    }
+    systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+    systick_set_reload(reload);
+}
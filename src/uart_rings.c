@@ -4,15 +4,12 @@
 #include "cobs.h"
 
 
-#define UART_RING_IN_BUF_SIZE               128
+#define UART_RING_IN_BUF_SIZE               512
 #define UART_RING_OUT_BUF_SIZE              256
 
 
-static volatile uint8_t _uart_ring_in_buf[UART_RING_IN_BUF_SIZE];
-static volatile uint8_t _uart_ring_out_buf[UART_RING_OUT_BUF_SIZE];
-
-static ring_buf_t _uart_ring_in = RING_BUF_INIT(_uart_ring_in_buf, UART_RING_IN_BUF_SIZE);
-static ring_buf_t _uart_ring_out = RING_BUF_INIT(_uart_ring_out_buf, UART_RING_OUT_BUF_SIZE);
+RING_BUF_DEFINE(_uart_ring_in, UART_RING_IN_BUF_SIZE);
+RING_BUF_DEFINE(_uart_ring_out, UART_RING_OUT_BUF_SIZE);
 
 
 uint32_t uart_rings_in_add(uint8_t* packet, uint32_t len)
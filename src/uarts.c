@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdbool.h>
 
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
@@ -10,6 +11,10 @@
 #include "pinmap.h"
 #include "util.h"
 #include "uart_rings.h"
+#include "events.h"
+#include "systick.h"
+#include "clocks.h"
+#include "clocks_calc.h"
 
 
 #define UART_ITF_BAUD           115200
@@ -18,6 +23,16 @@
 #define UART_ITF_PARITY         UART_PARITY_NONE
 #define UART_ITF_FLOWCONTROL    USART_FLOWCONTROL_NONE
 
+#define UARTS_ERROR_FLAGS       (USART_ISR_PE | USART_ISR_FE | USART_ISR_NF | USART_ISR_ORE)
+#define UARTS_TX_DONE_TIMEOUT_MS    10
+/* ~5.6ms at 115200, must go out within UARTS_TX_DONE_TIMEOUT_MS */
+#define UARTS_TX_BUF_SIZE           64
+/* ~22ms at 115200, the longest the main loop may go without polling it */
+#define UARTS_RX_BUF_SIZE           256
+#define UARTS_RX_BUF_MASK           (UARTS_RX_BUF_SIZE - 1)
+
+_Static_assert((UARTS_RX_BUF_SIZE & UARTS_RX_BUF_MASK) == 0, "RX buffer size must be a power of two");
+
 
 typedef enum {
     UARTS_STOP_BITS_1 = 0,
@@ -33,7 +48,25 @@ typedef enum {
 } _uarts_parity_t;
 
 
-static bool _uarts_getc(uint32_t uart, char* c);
+static void _uarts_set_baud(uint32_t uart, uint32_t baud);
+static void _uarts_clocks_notifier(clocks_change_t change);
+static void _uarts_tx_kick(void);
+static void _uarts_rx_start(void);
+static void _uarts_rx_poll(void);
+
+
+/* DMA reads from here, as the ring's contents can wrap */
+static uint8_t _uarts_tx_buf[UARTS_TX_BUF_SIZE] = {0};
+static volatile bool _uarts_tx_busy = false;
+static volatile bool _uarts_tx_hold = false;
+/* Received by circular DMA rather than per byte interrupts, so reception
+ * carries on while the CPU is stalled, e.g. by flash programming */
+static volatile uint8_t _uarts_rx_buf[UARTS_RX_BUF_SIZE] = {0};
+static uint32_t _uarts_rx_pos = 0;
+#ifdef ISR_BENCH_ENABLED
+static volatile uint32_t _uarts_isr_cycles_max = 0;
+static uint32_t _uarts_isr_cycles_reported = 0;
+#endif
 
 
 int uarts_init(void)
@@ -47,49 +80,168 @@ int uarts_init(void)
     usart_set_mode(UART_ITF_UART, USART_MODE_TX_RX);
     usart_set_flow_control(UART_ITF_UART, UART_ITF_FLOWCONTROL);
 
-    usart_set_baudrate(UART_ITF_UART, UART_ITF_BAUD);
+    _uarts_set_baud(UART_ITF_UART, UART_ITF_BAUD);
     usart_set_databits(UART_ITF_UART, UART_ITF_DATA_BITS);
     usart_set_stopbits(UART_ITF_UART, UART_ITF_STOP_BITS);
     usart_set_parity(UART_ITF_UART, UART_ITF_PARITY);
 
+    rcc_periph_clock_enable(UART_ITF_DMA_RCC);
+    _uarts_rx_start();
+    nvic_set_priority(UART_ITF_DMA_IRQ, IRQ_PRIORITY_DEFAULT);
+    nvic_enable_irq(UART_ITF_DMA_IRQ);
+
+    /* only line errors interrupt, data arrives by DMA */
+    nvic_set_priority(UART_ITF_IRQ, IRQ_PRIORITY_DEFAULT);
     nvic_enable_irq(UART_ITF_IRQ);
+    usart_enable_error_interrupt(UART_ITF_UART);
     usart_enable(UART_ITF_UART);
-    usart_enable_rx_interrupt(UART_ITF_UART);
-
-    nvic_enable_irq(UART_ITF_DMA_IRQ);
+    clocks_register_notifier(_uarts_clocks_notifier);
     return 0;
 }
 
 
-void __attribute__((interrupt)) usart3_4_isr(void)
+void uarts_iterate(void)
 {
-    char c = 0;
-    if (!_uarts_getc(UART_ITF_UART, &c)) {
-        return;
+    _uarts_rx_poll();
+    /* once started, transfers chain from the DMA interrupt until the ring
+     * is empty, so this only has to start them */
+    if (!_uarts_tx_busy) {
+        _uarts_tx_kick();
+    }
+#ifdef ISR_BENCH_ENABLED
+    uint32_t cycles_max = _uarts_isr_cycles_max;
+    if (cycles_max != _uarts_isr_cycles_reported &&
+        events_post(EVENTS_TYPE_ISR_CYCLES, cycles_max)) {
+        _uarts_isr_cycles_reported = cycles_max;
+    }
+#endif
+}
+
+
+void __attribute__((interrupt)) usart2_isr(void)
+{
+    uint32_t flags = USART_ISR(UART_ITF_UART) & UARTS_ERROR_FLAGS;
+    if (flags) {
+        /* error flags share bit positions between ISR and ICR */
+        USART_ICR(UART_ITF_UART) = flags;
+        events_post(EVENTS_TYPE_UART_ERROR, flags);
     }
-    uart_rings_in_add((uint8_t*)&c, 1);
 }
 
 
 void __attribute__((interrupt)) dma1_channel4_7_dma2_channel3_5_isr(void)
 {
-    if (!(DMA1_ISR & DMA_ISR_TCIF(UART_ITF_DMA_CHAN))) {
+#ifdef ISR_BENCH_ENABLED
+    uint32_t start = systick_cycles_now();
+#endif
+    if (DMA1_ISR & DMA_ISR_TCIF(UART_ITF_DMA_TX_CHAN)) {
+        DMA1_IFCR |= DMA_IFCR_CTCIF(UART_ITF_DMA_TX_CHAN);
+        dma_disable_transfer_complete_interrupt(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN);
+        usart_disable_tx_dma(UART_ITF_UART);
+        dma_disable_channel(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN);
+        _uarts_tx_busy = false;
+        _uarts_tx_kick();
+    }
+#ifdef ISR_BENCH_ENABLED
+    uint32_t cycles = systick_cycles_since(start);
+    if (cycles > _uarts_isr_cycles_max) {
+        _uarts_isr_cycles_max = cycles;
+    }
+#endif
+}
+
+
+/* Only called while no transfer is running, from the main loop or the DMA
+ * interrupt, so those never both read the out ring */
+static void _uarts_tx_kick(void)
+{
+    if (_uarts_tx_hold) {
+        return;
+    }
+    uint32_t len = uart_rings_out_drain(_uarts_tx_buf, UARTS_TX_BUF_SIZE);
+    if (!len) {
+        return;
+    }
+    _uarts_tx_busy = true;
+    dma_channel_reset(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN);
+    dma_set_peripheral_address(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN, (uint32_t)&USART_TDR(UART_ITF_UART));
+    dma_set_memory_address(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN, (uint32_t)_uarts_tx_buf);
+    dma_set_number_of_data(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN, len);
+    dma_set_read_from_memory(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN);
+    dma_enable_memory_increment_mode(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN);
+    dma_set_peripheral_size(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN, DMA_CCR_PSIZE_8BIT);
+    dma_set_memory_size(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN, DMA_CCR_MSIZE_8BIT);
+    dma_set_priority(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN, DMA_CCR_PL_LOW);
+    dma_enable_transfer_complete_interrupt(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN);
+    usart_enable_tx_dma(UART_ITF_UART);
+    dma_enable_channel(UART_ITF_DMA, UART_ITF_DMA_TX_CHAN);
+}
+
+
+static void _uarts_rx_start(void)
+{
+    dma_channel_reset(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN);
+    dma_set_peripheral_address(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN, (uint32_t)&USART_RDR(UART_ITF_UART));
+    dma_set_memory_address(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN, (uint32_t)_uarts_rx_buf);
+    dma_set_number_of_data(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN, UARTS_RX_BUF_SIZE);
+    dma_set_read_from_peripheral(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN);
+    dma_enable_memory_increment_mode(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN);
+    dma_enable_circular_mode(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN);
+    dma_set_peripheral_size(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN, DMA_CCR_PSIZE_8BIT);
+    dma_set_memory_size(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN, DMA_CCR_MSIZE_8BIT);
+    /* must never wait behind TX, a missed byte is lost */
+    dma_set_priority(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN, DMA_CCR_PL_HIGH);
+    usart_enable_rx_dma(UART_ITF_UART);
+    dma_enable_channel(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN);
+}
+
+
+/* Moves what the DMA has written since the last poll into the in ring */
+static void _uarts_rx_poll(void)
+{
+    uint32_t w_pos = (UARTS_RX_BUF_SIZE - DMA_CNDTR(UART_ITF_DMA, UART_ITF_DMA_RX_CHAN)) & UARTS_RX_BUF_MASK;
+    while (_uarts_rx_pos != w_pos) {
+        uint32_t end = (w_pos > _uarts_rx_pos) ? w_pos : UARTS_RX_BUF_SIZE;
+        uint32_t len = end - _uarts_rx_pos;
+        uint32_t added = uart_rings_in_add((uint8_t*)&_uarts_rx_buf[_uarts_rx_pos], len);
+        _uarts_rx_pos = (_uarts_rx_pos + added) & UARTS_RX_BUF_MASK;
+        if (added < len) {
+            /* drop the rest, as the per byte interrupt did */
+            events_post(EVENTS_TYPE_UART_RX_OVERFLOW, 0);
+            _uarts_rx_pos = w_pos;
+        }
+    }
+}
+
+
+static void _uarts_set_baud(uint32_t uart, uint32_t baud)
+{
+    /* USART2 is clocked from APB1 */
+    uint32_t brr = 0;
+    if (!clocks_calc_usart_brr(rcc_apb1_frequency, baud, &brr)) {
         return;
     }
-    DMA1_IFCR |= DMA_IFCR_CTCIF(UART_ITF_DMA_CHAN);
-    dma_disable_transfer_complete_interrupt(DMA1, UART_ITF_DMA_CHAN);
-    usart_disable_tx_dma(UART_ITF_DMA_CHAN);
-    dma_disable_channel(DMA1, UART_ITF_DMA_CHAN);
+    USART_BRR(uart) = brr;
 }
 
 
-static bool _uarts_getc(uint32_t uart, char* c)
+static void _uarts_clocks_notifier(clocks_change_t change)
 {
-    uint32_t flags = USART_ISR(uart);
-    if (!(flags & USART_ISR_RXNE)) {
-        USART_ICR(uart) = flags;
-        return false;
+    /* BRR can only be written while the USART is disabled */
+    if (CLOCKS_CHANGE_PRE == change) {
+        /* let the transfer running finish, but start no more */
+        _uarts_tx_hold = true;
+        uint32_t start_time = get_since_boot_ms();
+        while (_uarts_tx_busy || !(USART_ISR(UART_ITF_UART) & USART_ISR_TC)) {
+            if (since_boot_delta(get_since_boot_ms(), start_time) > UARTS_TX_DONE_TIMEOUT_MS) {
+                break;
+            }
+        }
+        usart_disable(UART_ITF_UART);
+    } else {
+        _uarts_set_baud(UART_ITF_UART, UART_ITF_BAUD);
+        usart_enable(UART_ITF_UART);
+        _uarts_tx_hold = false;
+        uarts_iterate();
     }
-    *c = usart_recv(uart);
-    return true;
 }
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include "systick.h"
+#include "itf.h"
+
+
+/* Host stand-ins for what events.c uses, so the queue can be exercised
+ * from the tests. Sent events are captured until collected. */
+#define EVENTS_STUBS_SENT_MAX           64
+
+
+static uint32_t _events_stubs_primask = 0;
+static uint32_t _events_stubs_now_ms = 0;
+static bool _events_stubs_send_ok = true;
+static itf_event_t _events_stubs_sent[EVENTS_STUBS_SENT_MAX] = {0};
+static uint32_t _events_stubs_sent_count = 0;
+
+
+uint32_t cm_mask_interrupts(uint32_t mask)
+{
+    uint32_t old = _events_stubs_primask;
+    _events_stubs_primask = mask;
+    return old;
+}
+
+
+uint32_t get_since_boot_ms(void)
+{
+    return _events_stubs_now_ms;
+}
+
+
+bool itf_send_events(itf_event_t* events, uint32_t count)
+{
+    if (!_events_stubs_send_ok) {
+        return false;
+    }
+    for (uint32_t i = 0; (i < count) && (_events_stubs_sent_count < EVENTS_STUBS_SENT_MAX); i++) {
+        _events_stubs_sent[_events_stubs_sent_count++] = events[i];
+    }
+    return true;
+}
+
+
+void events_stubs_set_now_ms(uint32_t now_ms)
+{
+    _events_stubs_now_ms = now_ms;
+}
+
+
+void events_stubs_set_send_ok(bool send_ok)
+{
+    _events_stubs_send_ok = send_ok;
+}
+
+
+uint32_t events_stubs_primask(void)
+{
+    return _events_stubs_primask;
+}
+
+
+/* Copies out and forgets what has been sent so far */
+uint32_t events_stubs_collect(itf_event_t* events, uint32_t count)
+{
+    if (count > _events_stubs_sent_count) {
+        count = _events_stubs_sent_count;
+    }
+    memcpy(events, _events_stubs_sent, count * sizeof(itf_event_t));
+    _events_stubs_sent_count = 0;
+    return count;
+}
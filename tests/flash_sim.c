@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "flash.h"
+
+
+/* File-backed stand-in for the download slot so firmware update can be
+ * exercised on the host. */
+#define FLASH_SIM_DEFAULT_PATH          "build/tests/flash_sim.bin"
+
+
+static uint32_t _flash_sim_applied_len = 0;
+
+
+static FILE* _flash_sim_open(void)
+{
+    const char* path = getenv("FLASH_SIM_PATH");
+    if (!path) {
+        path = FLASH_SIM_DEFAULT_PATH;
+    }
+    FILE* f = fopen(path, "r+b");
+    if (!f) {
+        f = fopen(path, "w+b");
+    }
+    return f;
+}
+
+
+bool flash_slot_erase(uint32_t len)
+{
+    if (FLASH_SLOT_SIZE < len) {
+        return false;
+    }
+    FILE* f = _flash_sim_open();
+    if (!f) {
+        return false;
+    }
+    /* erase whole pages, as the hardware does */
+    uint32_t pages = (len + FLASH_SLOT_PAGE_SIZE - 1) / FLASH_SLOT_PAGE_SIZE;
+    bool ok = true;
+    for (uint32_t i = 0; ok && (i < pages * FLASH_SLOT_PAGE_SIZE); i++) {
+        ok = EOF != fputc(0xFF, f);
+    }
+    fclose(f);
+    return ok;
+}
+
+
+bool flash_slot_write(uint32_t offset, const uint8_t* data, uint32_t len)
+{
+    if ((offset & 1) || (FLASH_SLOT_SIZE < offset + len)) {
+        return false;
+    }
+    FILE* f = _flash_sim_open();
+    if (!f) {
+        return false;
+    }
+    bool ok = true;
+    for (uint32_t i = 0; ok && (i < len); i++) {
+        /* programming can only clear bits */
+        ok = (0 == fseek(f, offset + i, SEEK_SET));
+        int c = ok ? fgetc(f) : EOF;
+        ok = ok && (EOF != c) && (0 == fseek(f, offset + i, SEEK_SET));
+        ok = ok && (EOF != fputc(c & data[i], f));
+    }
+    fclose(f);
+    return ok;
+}
+
+
+bool flash_slot_read(uint32_t offset, uint8_t* data, uint32_t len)
+{
+    if (FLASH_SLOT_SIZE < offset + len) {
+        return false;
+    }
+    FILE* f = _flash_sim_open();
+    if (!f) {
+        return false;
+    }
+    bool ok = (0 == fseek(f, offset, SEEK_SET)) && (len == fread(data, 1, len, f));
+    fclose(f);
+    return ok;
+}
+
+
+void flash_slot_apply(uint32_t len)
+{
+    _flash_sim_applied_len = len;
+}
+
+
+uint32_t flash_sim_applied_len(void)
+{
+    return _flash_sim_applied_len;
+}
@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "uart_rings.h"
+#include "system.h"
+#include "systick.h"
+#include "util.h"
+#include "events.h"
+#include "fw_update.h"
+#include "clocks.h"
+#include "htu21d.h"
+
+
+/* Host stand-ins for what itf.c uses, so frames can be passed between it
+ * and the Python API. Bytes given to itf_stubs_receive() are what it reads
+ * from the link, what it sends is captured until collected. */
+#define ITF_STUBS_BUF_SIZE              512
+
+
+static uint8_t _itf_stubs_in[ITF_STUBS_BUF_SIZE] = {0};
+static uint32_t _itf_stubs_in_len = 0;
+static uint32_t _itf_stubs_in_pos = 0;
+static uint8_t _itf_stubs_out[ITF_STUBS_BUF_SIZE] = {0};
+static uint32_t _itf_stubs_out_len = 0;
+static uint32_t _itf_stubs_bad_packets = 0;
+
+
+uint32_t uart_rings_in_drain(uint8_t* packet, uint32_t len)
+{
+    uint32_t i = 0;
+    while ((i < len) && (_itf_stubs_in_pos < _itf_stubs_in_len)) {
+        uint8_t c = _itf_stubs_in[_itf_stubs_in_pos++];
+        packet[i++] = c;
+        if (0 == c) {
+            break;
+        }
+    }
+    return i;
+}
+
+
+uint32_t uart_rings_out_add(uint8_t* packet, uint32_t len)
+{
+    if (ITF_STUBS_BUF_SIZE - _itf_stubs_out_len < len) {
+        return 0;
+    }
+    memcpy(&_itf_stubs_out[_itf_stubs_out_len], packet, len);
+    _itf_stubs_out_len += len;
+    return len;
+}
+
+
+bool events_post(events_type_t type, uint32_t arg)
+{
+    if (EVENTS_TYPE_ITF_BAD_PACKET == type) {
+        _itf_stubs_bad_packets++;
+    }
+    return true;
+}
+
+
+void system_reset(void)
+{
+}
+
+
+uint32_t get_since_boot_ms(void)
+{
+    return 0;
+}
+
+
+uint32_t since_boot_delta(uint32_t newer, uint32_t older)
+{
+    return newer - older;
+}
+
+
+void clocks_hold_high(clocks_holder_t holder, bool hold)
+{
+}
+
+
+bool htu21d_trigger(uint16_t request_id)
+{
+    return true;
+}
+
+
+void fw_update_begin(uint32_t size, uint32_t crc, itf_fw_status_t* status)
+{
+    memset(status, 0, sizeof(itf_fw_status_t));
+}
+
+
+void fw_update_block(uint32_t offset, const uint8_t* data, uint32_t len, uint32_t crc, itf_fw_status_t* status)
+{
+    memset(status, 0, sizeof(itf_fw_status_t));
+}
+
+
+void fw_update_end(itf_fw_status_t* status)
+{
+    memset(status, 0, sizeof(itf_fw_status_t));
+}
+
+
+bool fw_update_apply(void)
+{
+    return false;
+}
+
+
+bool itf_stubs_receive(const uint8_t* data, uint32_t len)
+{
+    if (ITF_STUBS_BUF_SIZE < len) {
+        return false;
+    }
+    memcpy(_itf_stubs_in, data, len);
+    _itf_stubs_in_len = len;
+    _itf_stubs_in_pos = 0;
+    return true;
+}
+
+
+/* Copies out and forgets what has been sent so far */
+uint32_t itf_stubs_collect(uint8_t* data, uint32_t len)
+{
+    if (len > _itf_stubs_out_len) {
+        len = _itf_stubs_out_len;
+    }
+    memcpy(data, _itf_stubs_out, len);
+    _itf_stubs_out_len = 0;
+    return len;
+}
+
+
+uint32_t itf_stubs_bad_packets(void)
+{
+    return _itf_stubs_bad_packets;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+
+/* Host stand-in, implemented by tests/events_stubs.c */
+uint32_t cm_mask_interrupts(uint32_t mask);
@@ -1,31 +1,49 @@
-import binascii
+import asyncio
 import os
 import pty
+import json
+import select
+import socket
 import struct
 import sys
+import threading
 
 from unittest.mock import patch
 
+import pytest
+import serial
+
 sys.path.append(os.path.join(os.path.dirname(__file__), os.path.pardir, "api"))
 
-from pyeese import Connection
-from pyeese.connection import PacketInType
-from pyeese.cobs import encode
+from pyeese import Connection, Event, EventType, NackError, NackReason, WindowFullError
+from pyeese.connection import PacketInType, PacketOutType, device_crc32
+from pyeese.cobs import encode, decode
+from pyeese import firmware
+from pyeese import profile
+from pyeese.daemon import Daemon, DaemonError
+from pyeese import shm
+from pyeese.shm import SampleReader, SampleWriter
+
+
+HEADER_SIZE = struct.calcsize(Connection.HEADER_STRUCT)
 
 
-def _get_connection():
+def _get_connection(**kwargs):
     master_fd, slave_fd = pty.openpty()
     slave_path = os.readlink(f"/proc/self/fd/{slave_fd}")
-    return master_fd, Connection(tty=slave_path)
+    return master_fd, Connection(tty=slave_path, **kwargs)
 
-def _send_packet(fd: int, type_: PacketInType, payload: bytes = b""):
+def _send_packet(fd: int, type_: PacketInType, payload: bytes = b"", seq: int = 0, request_id: int = 0, flags: int = 0):
     header = struct.pack(
         Connection.HEADER_STRUCT,
         Connection.PROTOCOL_VERSION,
-        type_.value
+        type_.value,
+        flags,
+        seq,
+        request_id,
     )
-    crc = binascii.crc32(header + payload)
-    packet = header + payload + crc.to_bytes(4)
+    crc = device_crc32(header + payload)
+    packet = header + payload + crc.to_bytes(4, "little")
     enc = encode(packet)
     enc += (0).to_bytes(1)
     os.write(fd, enc)
@@ -54,3 +72,340 @@ def test_measurements():
     assert temperature == conn_temperature, f"Temperature is wrong ({temperature} != {conn_temperature})"
     conn_relative_humidity = conn.relative_humidity
     assert relative_humidity == conn_relative_humidity, f"Temperature is wrong ({relative_humidity} != {conn_relative_humidity})"
+
+def test_events():
+    master_fd, conn = _get_connection()
+    payload = struct.pack(Connection.EVENT_STRUCT, 1000, EventType.UART_ERROR.value, 3, 0x8)
+    payload += struct.pack(Connection.EVENT_STRUCT, 1200, 0xFF, 1, 0)
+    _send_packet(master_fd, PacketInType.EVENT, payload)
+    conn.iterate()
+    events = conn.pop_events()
+    expected = [
+        Event(EventType.UART_ERROR, 1000, 3, 0x8),
+        Event(0xFF, 1200, 1, 0),
+    ]
+    assert events == expected, f"Events are wrong ({events} != {expected})"
+    assert conn.pop_events() == [], "Events should be cleared once popped"
+
+
+def test_link_stats():
+    master_fd, conn = _get_connection()
+    packets = [
+        (0xFFFC, 0), (0xFFFD, 0),
+        (0, 0), (1, 0),  # wrapped, 0xFFFE and 0xFFFF lost
+        (1, Connection.FLAG_BOOT), (2, Connection.FLAG_BOOT),  # reset, 0 lost
+        (5, Connection.FLAG_BOOT),  # 3 and 4 lost
+    ]
+    for seq, flags in packets:
+        _send_packet(master_fd, PacketInType.NOP, seq=seq, flags=flags)
+    conn.iterate()
+    stats = conn.link_stats
+    assert stats.received == 7, f"Wrong received count ({stats})"
+    assert stats.lost == 5, f"Wrong lost count ({stats})"
+    assert stats.restarts == 1, f"Wrong restart count ({stats})"
+    assert stats.loss_ratio == 5 / 12, f"Wrong loss ratio ({stats.loss_ratio})"
+
+def _fake_device(fd: int, stop: threading.Event, handle):
+    """Calls handle(type_, request_id, payload) for every packet from the host until stopped."""
+    leftovers = b""
+    while not stop.is_set():
+        rs, *_ = select.select([fd], [], [], 0.05)
+        if not rs:
+            continue
+        leftovers += os.read(fd, 4096)
+        while b"\x00" in leftovers:
+            enc, leftovers = leftovers.split(b"\x00", 1)
+            packet = decode(enc)
+            _, type_, _, _, request_id = struct.unpack(Connection.HEADER_STRUCT, packet[:HEADER_SIZE])
+            handle(PacketOutType(type_), request_id, packet[HEADER_SIZE:-4])
+
+def _start_fake_device(fd: int, handle):
+    stop = threading.Event()
+    device = threading.Thread(target=_fake_device, args=(fd, stop, handle))
+    device.start()
+    return stop, device
+
+def test_requests():
+    master_fd, conn = _get_connection(window=4, timeout=0.2)
+    seqs = iter(range(1000))
+
+    def handle(type_, request_id, payload):
+        """Acks NOPs, nacks TRIGGERs and ignores everything else."""
+        if type_ == PacketOutType.NOP:
+            _send_packet(master_fd, PacketInType.ACK, seq=next(seqs), request_id=request_id)
+        elif type_ == PacketOutType.TRIGGER:
+            nack = struct.pack(Connection.NACK_STRUCT, NackReason.BUSY.value)
+            _send_packet(master_fd, PacketInType.NACK, nack, seq=next(seqs), request_id=request_id)
+
+    stop, device = _start_fake_device(master_fd, handle)
+    try:
+        nops = [conn.send_nop() for _ in range(4)]
+        with pytest.raises(WindowFullError):
+            conn.send_nop()
+        for _ in range(6):
+            conn.wait_room()
+            nops.append(conn.send_nop())
+            assert conn.in_flight <= 4, f"Window exceeded ({conn.in_flight})"
+        conn.wait_all()
+        assert all(nop.result() is None for nop in nops), "NOPs should all be acked"
+        # the async path waits for room rather than raising
+        nops = [conn.send_nop() for _ in range(4)]
+        with pytest.raises(NackError):
+            asyncio.run(conn.read_now_async())
+        conn.wait_all()
+        try:
+            conn.wait(conn.send_trigger())
+            assert False, "Trigger should be refused"
+        except NackError as e:
+            assert e.reason == NackReason.BUSY, f"Wrong reason ({e.reason})"
+        try:
+            conn.wait(conn.send_fw_end())
+            assert False, "FW_END should time out"
+        except TimeoutError:
+            pass
+        assert conn.in_flight == 0, f"Requests left in flight ({conn.in_flight})"
+        assert conn.link_stats.lost == 0, f"Nothing should be lost ({conn.link_stats})"
+    finally:
+        stop.set()
+        device.join()
+
+def test_read_now():
+    master_fd, conn = _get_connection()
+
+    def handle(type_, request_id, payload):
+        """Answers TRIGGERs, ignoring the first one and failing the fourth."""
+        if type_ != PacketOutType.TRIGGER or request_id == 1:
+            return
+        _send_packet(master_fd, PacketInType.ACK, request_id=request_id)
+        if request_id == 4:
+            nack = struct.pack(Connection.NACK_STRUCT, NackReason.SENSOR.value)
+            _send_packet(master_fd, PacketInType.NACK, nack, request_id=request_id)
+            return
+        measurements = struct.pack(Connection.MEASUREMENTS_STRUCT, 2000 + request_id, 4000)
+        _send_packet(master_fd, PacketInType.MEASUREMENTS, measurements)
+        _send_packet(master_fd, PacketInType.SAMPLE, measurements, request_id=request_id)
+
+    stop, device = _start_fake_device(master_fd, handle)
+    try:
+        try:
+            conn.read_now(timeout=0.2)
+            assert False, "First trigger is ignored so should time out"
+        except TimeoutError:
+            pass
+        sample = conn.read_now()
+        assert sample == (20.02, 40.0), f"Wrong sample ({sample})"
+        assert conn.temperature == 20.02, f"Wrong temperature ({conn.temperature})"
+        sample = asyncio.run(conn.read_now_async())
+        assert sample == (20.03, 40.0), f"Wrong async sample ({sample})"
+        try:
+            conn.read_now()
+            assert False, "Failed measurement should raise"
+        except NackError as e:
+            assert e.reason == NackReason.SENSOR, f"Wrong reason ({e.reason})"
+    finally:
+        stop.set()
+        device.join()
+
+def test_firmware_update():
+    master_fd, conn = _get_connection()
+    image = os.urandom(1000)
+    received = bytearray()
+    device_state = {"state": 0, "size": 0, "crc": 0, "offset": 0, "dropped": False}
+    stop = None
+
+    def handle(type_, request_id, payload):
+        """Minimal device side of firmware update that loses one block."""
+        d = device_state
+        result = firmware.FwResult.OK
+        if type_ == PacketOutType.FW_BEGIN:
+            d["state"] = firmware.FwState.RECEIVING.value
+            d["size"], d["crc"] = struct.unpack(Connection.FW_BEGIN_STRUCT, payload)
+        elif type_ == PacketOutType.FW_BLOCK:
+            block_offset, block_crc = struct.unpack(Connection.FW_BLOCK_STRUCT, payload[:8])
+            data = payload[8:]
+            if block_offset == 2 * Connection.FW_BLOCK_MAX and not d["dropped"]:
+                d["dropped"] = True
+                return
+            if block_offset > d["offset"]:
+                result = firmware.FwResult.OUT_OF_ORDER
+            elif block_offset == d["offset"]:
+                assert block_crc == device_crc32(data)
+                received[block_offset:block_offset + len(data)] = data
+                d["offset"] += len(data)
+        elif type_ == PacketOutType.FW_END:
+            if device_crc32(bytes(received[:d["size"]])) == d["crc"]:
+                d["state"] = firmware.FwState.COMPLETE.value
+            else:
+                result = firmware.FwResult.IMAGE_CRC
+        else:
+            stop.set()
+            return
+        status = struct.pack(Connection.FW_STATUS_STRUCT, d["state"], result.value, d["offset"], d["size"])
+        _send_packet(master_fd, PacketInType.FW_STATUS, status)
+        _send_packet(master_fd, PacketInType.ACK, request_id=request_id)
+
+    stop, device = _start_fake_device(master_fd, handle)
+    try:
+        firmware.update(conn, image, window=4, timeout=0.5)
+    finally:
+        stop.wait(1.0)
+        stop.set()
+        device.join()
+    assert bytes(received) == image, "Image received by device does not match"
+
+def test_profile():
+    master_fd, conn = _get_connection()
+    base = 0x08000000
+    header = struct.pack(Connection.PROFILE_STRUCT, base, 6, 0, 1)
+    entries = struct.pack(Connection.PROFILE_ENTRY_STRUCT, 2, 40)
+    _send_packet(master_fd, PacketInType.PROFILE, header + entries)
+    header = struct.pack(Connection.PROFILE_STRUCT, base, 6, 1, 1)
+    entries = struct.pack(Connection.PROFILE_ENTRY_STRUCT, 3, 10)
+    entries += struct.pack(Connection.PROFILE_ENTRY_STRUCT, Connection.PROFILE_BUCKET_OTHER, 5)
+    _send_packet(master_fd, PacketInType.PROFILE, header + entries)
+    conn.iterate()
+    profiles = conn.pop_profiles()
+    assert len(profiles) == 1, f"Expected one complete snapshot ({len(profiles)})"
+    assert profiles[0].counts == {2: 40, 3: 10}, f"Wrong counts ({profiles[0].counts})"
+
+    # bucket 2 is 0x80-0xBF, half in each function, bucket 3 is 0xC0-0xFF
+    symbols = [
+        profile.Symbol(base + 0x60, 0x40, "crc32"),
+        profile.Symbol(base + 0xA0, 0x30, "itf_iterate"),
+    ]
+    samples = profile.symbolise(profiles[0], symbols)
+    expected = {
+        "crc32": 20.,
+        "itf_iterate": 20. + 10. * 0x10 / 0x40,
+        profile.UNKNOWN: 10. * 0x30 / 0x40,
+        profile.OTHER: 5.,
+    }
+    assert samples == expected, f"Wrong symbolised samples ({samples} != {expected})"
+    assert "crc32" in profile.format_flat(samples)
+
+def test_shm():
+    writer = SampleWriter(f"pyeese-test-{os.getpid()}", ["a", "b"], slot_count=4)
+    try:
+        reader = SampleReader(writer.name)
+        assert reader.devices == ["a", "b"], f"Wrong devices ({reader.devices})"
+        assert reader.latest("a") is None, "No sample published yet"
+        writer.publish(0, 20.0, 40.0, timestamp=1.0)
+        writer.publish(1, 21.0, 41.0, timestamp=2.0)
+        samples = reader.read_new()
+        assert [s.seq for s in samples] == [1, 2], f"Wrong samples ({samples})"
+        assert reader.latest("b").temperature == 21.0, f"Wrong latest ({reader.latest('b')})"
+        for i in range(6):
+            writer.publish(0, 30.0 + i, 50.0)
+        samples = reader.read_new()
+        assert [s.seq for s in samples] == [5, 6, 7, 8], f"Should skip lapped samples ({samples})"
+        assert reader.lost == 2, f"Wrong lost count ({reader.lost})"
+        assert reader.latest(0).temperature == 35.0, f"Wrong latest ({reader.latest(0)})"
+        # writer dying mid-write must not hang readers
+        offset = reader._layout.latest_slot(1)
+        struct.pack_into("<Q", writer._shm.buf, offset, shm.WRITING)
+        try:
+            reader.latest(1)
+            assert False, "Slot left mid-write should raise"
+        except shm.ShmError:
+            pass
+        reader.close()
+    finally:
+        writer.close()
+
+def test_shm_writer_checks():
+    name = f"pyeese-test-{os.getpid()}"
+    try:
+        SampleWriter(name, ["/dev/serial/by-id/usb-STMicroelectronics_STM32_0123456789"])
+        assert False, "Long device name should be refused"
+    except ValueError:
+        pass
+    stale = SampleWriter(name, ["a"])
+    try:
+        SampleWriter(name, ["a"])
+        assert False, "Name of a running writer should be refused"
+    except FileExistsError:
+        pass
+    # pretend the writer crashed, pid 0 is never a live writer
+    struct.pack_into("<I", stale._shm.buf, 12, 0)
+    stale._shm.close()
+    writer = SampleWriter(name, ["b"])
+    try:
+        with SampleReader(name) as reader:
+            assert reader.devices == ["b"], f"Stale memory not replaced ({reader.devices})"
+    finally:
+        writer.close()
+
+def test_daemon(tmp_path):
+    master_fd, slave_fd = pty.openpty()
+    tty = os.readlink(f"/proc/self/fd/{slave_fd}")
+    socket_path = str(tmp_path / "pyeese.sock")
+    with Daemon([tty], f"pyeese-test-{os.getpid()}", socket_path) as daemon:
+        with SampleReader(daemon.shm_name) as reader:
+            payload = struct.pack(Connection.MEASUREMENTS_STRUCT, 2150, 4950)
+            _send_packet(master_fd, PacketInType.MEASUREMENTS, payload)
+            daemon.iterate()
+            latest = reader.latest(tty)
+            assert latest is not None, "Measurement not published"
+            assert latest.temperature == 21.5, f"Wrong temperature ({latest.temperature})"
+            assert latest.relative_humidity == 49.5, f"Wrong humidity ({latest.relative_humidity})"
+
+        client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        client.connect(socket_path)
+        daemon.iterate()
+        client.sendall(b'{"cmd": "info"}\n')
+        daemon.iterate()
+        info = json.loads(client.recv(4096))
+        assert info["devices"] == [tty], f"Wrong devices ({info})"
+        assert info["write_seq"] == 1, f"Wrong write_seq ({info})"
+        client.close()
+
+        # a client resetting the connection only drops that client
+        client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        client.connect(socket_path)
+        daemon.iterate()
+        client.sendall(b'{"cmd": "info"}\n' * 1000)
+        client.close()
+        for _ in range(3):
+            daemon.iterate(0)
+
+def test_daemon_socket_path(tmp_path):
+    master_fd, slave_fd = pty.openpty()
+    tty = os.readlink(f"/proc/self/fd/{slave_fd}")
+    socket_path = str(tmp_path / "pyeese.sock")
+    # left behind by a daemon that died, nothing listening
+    stale = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    stale.bind(socket_path)
+    stale.close()
+    with Daemon([tty], f"pyeese-test-{os.getpid()}", socket_path):
+        with pytest.raises(DaemonError):
+            Daemon([tty], f"pyeese-test2-{os.getpid()}", socket_path)
+        assert os.path.exists(socket_path), "Live daemon's socket removed"
+    other_path = tmp_path / "not-a-socket"
+    other_path.write_text("keep me")
+    with pytest.raises(DaemonError):
+        Daemon([tty], f"pyeese-test-{os.getpid()}", str(other_path))
+    assert other_path.read_text() == "keep me", "Non-socket file touched"
+
+def test_daemon_port_failure(tmp_path):
+    master_fd, slave_fd = pty.openpty()
+    tty = os.readlink(f"/proc/self/fd/{slave_fd}")
+    socket_path = str(tmp_path / "pyeese.sock")
+    with patch("pyeese.daemon.REOPEN_INTERVAL", 0.0), \
+         Daemon([tty], f"pyeese-test-{os.getpid()}", socket_path) as daemon:
+        client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        client.connect(socket_path)
+        daemon.iterate()
+        _send_packet(master_fd, PacketInType.NOP)
+        with patch.object(Connection, "iterate", side_effect=serial.SerialException("gone")), \
+             patch.object(Daemon, "_reopen"):
+            daemon.iterate()
+            client.sendall(json.dumps({"cmd": "nop", "device": tty}).encode() + b"\n")
+            daemon.iterate()
+        response = json.loads(client.recv(4096))
+        assert response == {"ok": False, "error": "device unavailable"}, f"Failed port still used ({response})"
+        daemon.iterate(0)
+        client.sendall(json.dumps({"cmd": "nop", "device": tty}).encode() + b"\n")
+        daemon.iterate()
+        response = json.loads(client.recv(4096))
+        assert response == {"ok": True}, f"Port not reopened ({response})"
+        client.close()
@@ -0,0 +1,41 @@
+import os
+import ctypes
+
+
+def _load():
+    path = os.path.join(os.getenv("BUILD_TESTS_DIR", "build/tests"), "clocks_calc.so")
+    lib_blob = ctypes.CDLL(path)
+    assert lib_blob, f"Library missing at {path}"
+    return lib_blob
+
+
+def test_systick_reload():
+    lib_blob = _load()
+    reload = ctypes.c_uint32()
+    for ahb_hz, expected in ((8000000, 7999), (48000000, 47999)):
+        assert lib_blob.clocks_calc_systick_reload(ahb_hz, 1000, ctypes.byref(reload)), f"Failed for {ahb_hz}"
+        assert reload.value == expected, f"Wrong reload for {ahb_hz} ({reload.value} != {expected})"
+    assert not lib_blob.clocks_calc_systick_reload(48000000, 1, ctypes.byref(reload)), "Reload should be too big"
+    assert not lib_blob.clocks_calc_systick_reload(8000000, 0, ctypes.byref(reload)), "Zero tick rate accepted"
+
+
+def test_usart_brr():
+    lib_blob = _load()
+    brr = ctypes.c_uint32()
+    for pclk_hz, baud, expected in ((8000000, 115200, 69), (48000000, 115200, 417), (48000000, 1000000, 48)):
+        assert lib_blob.clocks_calc_usart_brr(pclk_hz, baud, ctypes.byref(brr)), f"Failed for {pclk_hz}/{baud}"
+        assert brr.value == expected, f"Wrong BRR for {pclk_hz}/{baud} ({brr.value} != {expected})"
+    # BRR 17 from 8MHz is 2.1% off 460800
+    assert not lib_blob.clocks_calc_usart_brr(8000000, 460800, ctypes.byref(brr)), "Baud error out of tolerance accepted"
+    assert not lib_blob.clocks_calc_usart_brr(8000000, 3000000, ctypes.byref(brr)), "BRR below minimum accepted"
+    assert not lib_blob.clocks_calc_usart_brr(8000000, 0, ctypes.byref(brr)), "Zero baud accepted"
+
+
+def test_i2c_timing():
+    lib_blob = _load()
+    timingr = ctypes.c_uint32()
+    # Reference values from RM0091 for 100kHz
+    for i2c_hz, expected in ((8000000, 0x10420F13), (48000000, 0xB0420F13)):
+        assert lib_blob.clocks_calc_i2c_timing_sm(i2c_hz, ctypes.byref(timingr)), f"Failed for {i2c_hz}"
+        assert timingr.value == expected, f"Wrong TIMINGR for {i2c_hz} ({timingr.value:08X} != {expected:08X})"
+    assert not lib_blob.clocks_calc_i2c_timing_sm(128000000, ctypes.byref(timingr)), "Prescaler overflow accepted"
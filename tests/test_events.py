@@ -0,0 +1,98 @@
+import os
+import ctypes
+
+
+class Event(ctypes.Structure):
+    """
+    typedef struct {
+        uint32_t timestamp_ms;
+        uint16_t type;
+        uint16_t count;
+        uint32_t arg;
+    } __attribute__((packed)) itf_event_t;
+    """
+    _pack_ = 1
+    _fields_ = [
+        ("timestamp_ms", ctypes.c_uint32),
+        ("type", ctypes.c_uint16),
+        ("count", ctypes.c_uint16),
+        ("arg", ctypes.c_uint32),
+    ]
+
+
+EVENTS_TYPE_QUEUE_OVERFLOW = 1
+EVENTS_TYPE_UART_ERROR = 2
+EVENTS_TYPE_UART_RX_OVERFLOW = 3
+EVENTS_QUEUE_SIZE = 16
+EVENTS_PER_PACKET = 8
+UINT16_MAX = 0xFFFF
+
+
+def _load():
+    path = os.path.join(os.getenv("BUILD_TESTS_DIR", "build/tests"), "events.so")
+    lib_blob = ctypes.CDLL(path)
+    assert lib_blob, f"Library missing at {path}"
+    lib_blob.events_post.restype = ctypes.c_bool
+    lib_blob.events_stubs_set_send_ok(True)
+    # the library stays loaded between tests, start from an empty queue
+    _drain(lib_blob)
+    return lib_blob
+
+
+def _collect(lib_blob) -> list:
+    collected = (Event * 64)()
+    count = lib_blob.events_stubs_collect(collected, len(collected))
+    return [(event.type, event.count, event.arg, event.timestamp_ms) for event in collected[:count]]
+
+
+def _drain(lib_blob) -> list:
+    for _ in range(EVENTS_QUEUE_SIZE):
+        lib_blob.events_iterate()
+    return _collect(lib_blob)
+
+
+def test_events_coalesce():
+    lib_blob = _load()
+    lib_blob.events_stubs_set_now_ms(10)
+    assert lib_blob.events_post(EVENTS_TYPE_UART_ERROR, 4)
+    lib_blob.events_stubs_set_now_ms(20)
+    assert lib_blob.events_post(EVENTS_TYPE_UART_ERROR, 4)
+    assert lib_blob.events_post(EVENTS_TYPE_UART_ERROR, 4)
+    assert lib_blob.events_post(EVENTS_TYPE_UART_ERROR, 8)
+    assert lib_blob.events_post(EVENTS_TYPE_UART_ERROR, 4)
+    events = _drain(lib_blob)
+    assert events == [
+        (EVENTS_TYPE_UART_ERROR, 3, 4, 20),
+        (EVENTS_TYPE_UART_ERROR, 1, 8, 20),
+        (EVENTS_TYPE_UART_ERROR, 1, 4, 20),
+    ], f"Repeats should only coalesce into the last event ({events})"
+    assert lib_blob.events_stubs_primask() == 0, "Interrupts left masked"
+
+
+def test_events_count_cap():
+    lib_blob = _load()
+    for _ in range(UINT16_MAX + 2):
+        assert lib_blob.events_post(EVENTS_TYPE_UART_RX_OVERFLOW, 0)
+    counts = [count for _, count, _, _ in _drain(lib_blob)]
+    assert counts == [UINT16_MAX, 2], f"Count should stop at UINT16_MAX and start a new event ({counts})"
+
+
+def test_events_overflow():
+    lib_blob = _load()
+    for i in range(EVENTS_QUEUE_SIZE):
+        assert lib_blob.events_post(EVENTS_TYPE_UART_ERROR, i)
+    for i in range(3):
+        assert not lib_blob.events_post(EVENTS_TYPE_UART_ERROR, 100 + i), "Full queue should drop"
+    # nothing can be sent, so the overflow report finds the queue still full
+    lib_blob.events_stubs_set_send_ok(False)
+    lib_blob.events_iterate()
+    lib_blob.events_iterate()
+    assert not _collect(lib_blob), "Nothing should be sent while sends fail"
+    lib_blob.events_stubs_set_send_ok(True)
+    events = _drain(lib_blob)
+    args = [arg for type_, _, arg, _ in events if type_ == EVENTS_TYPE_UART_ERROR]
+    assert args == list(range(EVENTS_QUEUE_SIZE)), f"Failed sends should be retried in order ({args})"
+    overflows = [(count, arg) for type_, count, arg, _ in events if type_ == EVENTS_TYPE_QUEUE_OVERFLOW]
+    assert overflows == [(1, 3)], f"Each drop should be counted once, including failed reports ({overflows})"
+    assert lib_blob.events_stubs_primask() == 0, "Interrupts left masked"
+
@@ -0,0 +1,117 @@
+import binascii
+import os
+import struct
+import ctypes
+
+
+class FwStatus(ctypes.Structure):
+    """
+    typedef struct {
+        uint8_t state;
+        uint8_t result;
+        uint32_t offset;
+        uint32_t size;
+    } __attribute__((packed)) itf_fw_status_t;
+    """
+    _pack_ = 1
+    _fields_ = [
+        ("state", ctypes.c_uint8),
+        ("result", ctypes.c_uint8),
+        ("offset", ctypes.c_uint32),
+        ("size", ctypes.c_uint32),
+    ]
+
+
+FW_UPDATE_STATE_IDLE = 0
+FW_UPDATE_STATE_RECEIVING = 1
+FW_UPDATE_STATE_COMPLETE = 2
+FW_UPDATE_RESULT_OK = 0
+FW_UPDATE_RESULT_OUT_OF_ORDER = 4
+FW_UPDATE_RESULT_BAD_CRC = 5
+FW_UPDATE_RESULT_INCOMPLETE = 8
+FW_UPDATE_RESULT_BAD_IMAGE = 9
+FW_UPDATE_BLOCK_MAX = 64
+
+
+def _crc32(data: bytes) -> int:
+    # Device crc32() has no final XOR, unlike binascii
+    return binascii.crc32(data) ^ 0xFFFFFFFF
+
+
+def _image(size: int, sp: int = 0x20004000, reset: int = 0x080000C1) -> bytes:
+    # Initial stack pointer and reset handler the device will accept
+    return struct.pack("<II", sp, reset) + os.urandom(size - 8)
+
+
+def _load(tmp_path):
+    os.environ["FLASH_SIM_PATH"] = str(tmp_path / "flash_sim.bin")
+    path = os.path.join(os.getenv("BUILD_TESTS_DIR", "build/tests"), "fw_update.so")
+    lib_blob = ctypes.CDLL(path)
+    assert lib_blob, f"Library missing at {path}"
+    lib_blob.fw_update_block.argtypes = [
+        ctypes.c_uint32,
+        ctypes.c_char_p,
+        ctypes.c_uint32,
+        ctypes.c_uint32,
+        ctypes.POINTER(FwStatus),
+    ]
+    return lib_blob
+
+
+def _send_block(lib_blob, image: bytes, offset: int, status: FwStatus, crc: int | None = None):
+    data = image[offset:offset + FW_UPDATE_BLOCK_MAX]
+    if crc is None:
+        crc = _crc32(data)
+    lib_blob.fw_update_block(offset, data, len(data), crc, ctypes.pointer(status))
+
+
+def test_fw_update(tmp_path):
+    lib_blob = _load(tmp_path)
+    image = _image(1001)
+    status = FwStatus()
+    lib_blob.fw_update_begin(len(image), _crc32(image), ctypes.pointer(status))
+    assert status.result == FW_UPDATE_RESULT_OK, f"Begin failed ({status.result})"
+    assert status.state == FW_UPDATE_STATE_RECEIVING, f"Wrong state ({status.state})"
+
+    _send_block(lib_blob, image, 0, status)
+    _send_block(lib_blob, image, 2 * FW_UPDATE_BLOCK_MAX, status)
+    assert status.result == FW_UPDATE_RESULT_OUT_OF_ORDER, f"Gap not detected ({status.result})"
+    assert status.offset == FW_UPDATE_BLOCK_MAX, f"Wrong offset to resend from ({status.offset})"
+    _send_block(lib_blob, image, FW_UPDATE_BLOCK_MAX, status, crc=0)
+    assert status.result == FW_UPDATE_RESULT_BAD_CRC, f"Bad block CRC not detected ({status.result})"
+
+    lib_blob.fw_update_end(ctypes.pointer(status))
+    assert status.result == FW_UPDATE_RESULT_INCOMPLETE, f"Incomplete image accepted ({status.result})"
+
+    # Beginning the same image again resumes rather than restarting
+    lib_blob.fw_update_begin(len(image), _crc32(image), ctypes.pointer(status))
+    assert status.offset == FW_UPDATE_BLOCK_MAX, f"Did not resume ({status.offset})"
+
+    for offset in range(status.offset, len(image), FW_UPDATE_BLOCK_MAX):
+        _send_block(lib_blob, image, offset, status)
+        assert status.result == FW_UPDATE_RESULT_OK, f"Block {offset} failed ({status.result})"
+    lib_blob.fw_update_end(ctypes.pointer(status))
+    assert status.result == FW_UPDATE_RESULT_OK, f"Image check failed ({status.result})"
+    assert status.state == FW_UPDATE_STATE_COMPLETE, f"Wrong state ({status.state})"
+
+    with open(tmp_path / "flash_sim.bin", "rb") as f:
+        flash = f.read()
+    assert flash[:len(image)] == image, "Flash content does not match image"
+
+    assert lib_blob.fw_update_apply(), "Complete image should be applied"
+    applied_len = lib_blob.flash_sim_applied_len()
+    assert applied_len == len(image), f"Wrong length applied ({applied_len})"
+
+
+def test_fw_update_bad_vectors(tmp_path):
+    lib_blob = _load(tmp_path)
+    status = FwStatus()
+    for sp, reset in ((0xFFFFFFFF, 0x080000C1), (0x20004000, 0x080000C0), (0x20004000, 0x08010001)):
+        image = _image(200, sp, reset)
+        lib_blob.fw_update_begin(len(image), _crc32(image), ctypes.pointer(status))
+        for offset in range(0, len(image), FW_UPDATE_BLOCK_MAX):
+            _send_block(lib_blob, image, offset, status)
+        lib_blob.fw_update_end(ctypes.pointer(status))
+        assert status.result == FW_UPDATE_RESULT_BAD_IMAGE, f"Vectors {sp:#x} {reset:#x} accepted ({status.result})"
+        assert status.state == FW_UPDATE_STATE_IDLE, f"Wrong state ({status.state})"
+        assert not lib_blob.fw_update_apply(), "Image that cannot boot should not be applied"
@@ -0,0 +1,78 @@
+import os
+import pty
+import struct
+import sys
+import ctypes
+
+sys.path.append(os.path.join(os.path.dirname(__file__), os.path.pardir, "api"))
+
+from pyeese import Connection
+from pyeese.cobs import encode, decode
+
+
+ITF_STUBS_BUF_SIZE = 512
+
+
+def _load():
+    path = os.path.join(os.getenv("BUILD_TESTS_DIR", "build/tests"), "itf.so")
+    lib_blob = ctypes.CDLL(path)
+    assert lib_blob, f"Library missing at {path}"
+    lib_blob.itf_stubs_receive.restype = ctypes.c_bool
+    lib_blob.itf_send_measurements.restype = ctypes.c_bool
+    # the library stays loaded between tests, forget anything already sent
+    _collect(lib_blob)
+    return lib_blob
+
+
+def _collect(lib_blob) -> list[bytes]:
+    """Decoded frames the C side has sent since the last call."""
+    out = (ctypes.c_uint8 * ITF_STUBS_BUF_SIZE)()
+    count = lib_blob.itf_stubs_collect(out, len(out))
+    return [decode(enc) for enc in bytes(out[:count]).split(b"\x00") if enc]
+
+
+def _receive(lib_blob, data: bytes) -> None:
+    assert lib_blob.itf_stubs_receive(data, len(data)), "Too much for the stub"
+    lib_blob.itf_iterate()
+
+
+def _get_connection():
+    master_fd, slave_fd = pty.openpty()
+    slave_path = os.readlink(f"/proc/self/fd/{slave_fd}")
+    return master_fd, Connection(tty=slave_path)
+
+
+def test_itf_device_to_host():
+    lib_blob = _load()
+    measurements = (ctypes.c_uint8 * 8).from_buffer_copy(struct.pack(Connection.MEASUREMENTS_STRUCT, 2150, 4950))
+    assert lib_blob.itf_send_measurements(measurements), "Measurements not sent"
+    frames = _collect(lib_blob)
+    assert len(frames) == 1, f"Expected one frame ({frames})"
+    _, conn = _get_connection()
+    conn._parse_message(frames[0])
+    stats = conn.link_stats
+    assert stats.crc_errors == 0, "Host refused the device's CRC"
+    assert conn.temperature == 21.5, f"Wrong temperature ({conn.temperature})"
+    assert conn.relative_humidity == 49.5, f"Wrong humidity ({conn.relative_humidity})"
+
+
+def test_itf_host_to_device():
+    lib_blob = _load()
+    master_fd, conn = _get_connection()
+    nop = conn.send_nop()
+    sent = os.read(master_fd, 4096)
+    bad_packets = lib_blob.itf_stubs_bad_packets()
+    _receive(lib_blob, sent)
+    assert lib_blob.itf_stubs_bad_packets() == bad_packets, "Device refused the host's packet"
+    frames = _collect(lib_blob)
+    assert len(frames) == 1, f"Expected one ack ({frames})"
+    conn._parse_message(frames[0])
+    assert nop.done() and nop.exception() is None, "Ack from device not matched to the nop"
+
+    # a corrupted packet is dropped and reported, not acked
+    conn.send_nop()
+    packet = bytearray(decode(os.read(master_fd, 4096)[:-1]))
+    packet[-1] ^= 0x01
+    _receive(lib_blob, encode(bytes(packet)) + b"\x00")
+    assert lib_blob.itf_stubs_bad_packets() == bad_packets + 1, "Bad CRC not reported"
+    assert not _collect(lib_blob), "Corrupted packet acked"
@@ -6,14 +6,14 @@ class RingBuf(ctypes.Structure):
     """
     typedef struct {
         volatile uint8_t* buf;
-        uint32_t size;
+        uint32_t mask;
         volatile uint32_t r_pos;
         volatile uint32_t w_pos;
     } ring_buf_t;
     """
     _fields_ = [
         ("buf", ctypes.POINTER(ctypes.c_uint8)),
-        ("size", ctypes.c_uint32),
+        ("mask", ctypes.c_uint32),
         ("r_pos", ctypes.c_uint32),
         ("w_pos", ctypes.c_uint32),
     ]
@@ -22,7 +22,7 @@ class RingBuf(ctypes.Structure):
     def ring_buf_init(size: int = 128):
         buf = (ctypes.c_uint8 * size)()
         buf_ptr = ctypes.cast(buf, ctypes.POINTER(ctypes.c_uint8))
-        return RingBuf(buf_ptr, size, 0, 0)
+        return RingBuf(buf_ptr, size - 1, 0, 0)
 
 
 def test_ringbuf_read_write():
@@ -38,3 +38,42 @@ def test_ringbuf_read_write():
     to_read = lib_blob.ring_buf_read(ctypes.pointer(ring), r_data_ptr, 128)
     assert to_read == len(w_data_str), f"Wrong length to read returned ({to_read} != {len(w_data_str)})"
     assert w_data_str == r_data.value, f"Wrong text returned ({w_data_str} != {r_data.value})"
+
+
+def test_ringbuf_full_and_wrap():
+    path = os.path.join(os.getenv("BUILD_TESTS_DIR", "build/tests"), "ring_buf.so")
+    lib_blob = ctypes.CDLL(path)
+    assert lib_blob, f"Library missing at {path}"
+    ring = RingBuf.ring_buf_init(16)
+    w_data_str = bytes(range(1, 17))
+    written = lib_blob.ring_buf_write(ctypes.pointer(ring), ctypes.c_char_p(w_data_str), 20)
+    assert written == 16, f"Whole buffer should be usable ({written} != 16)"
+    r_data = (ctypes.c_uint8 * 16)()
+    to_read = lib_blob.ring_buf_read(ctypes.pointer(ring), r_data, 10)
+    assert to_read == 10, f"Wrong length to read returned ({to_read} != 10)"
+    w_data_str = b"\x20\x21\x22\x23\x00\x24"
+    written = lib_blob.ring_buf_write(ctypes.pointer(ring), ctypes.c_char_p(w_data_str), len(w_data_str))
+    assert written == len(w_data_str), f"Wrong length written ({written} != {len(w_data_str)})"
+    to_read = lib_blob.ring_buf_read_until(ctypes.pointer(ring), r_data, 16, 0)
+    expected = bytes(range(11, 17)) + w_data_str[:5]
+    assert bytes(r_data[:to_read]) == expected, f"Wrong data across wrap ({bytes(r_data[:to_read])} != {expected})"
+    to_read = lib_blob.ring_buf_read(ctypes.pointer(ring), r_data, 16)
+    assert bytes(r_data[:to_read]) == b"\x24", f"Wrong remaining data ({bytes(r_data[:to_read])})"
+    to_read = lib_blob.ring_buf_read_until(ctypes.pointer(ring), r_data, 16, 0)
+    assert to_read == 0, f"Empty ring should return nothing ({to_read})"
+
+
+def test_ringbuf_write_byte():
+    path = os.path.join(os.getenv("BUILD_TESTS_DIR", "build/tests"), "ring_buf.so")
+    lib_blob = ctypes.CDLL(path)
+    assert lib_blob, f"Library missing at {path}"
+    lib_blob.ring_buf_write_byte.restype = ctypes.c_bool
+    ring = RingBuf.ring_buf_init(4)
+    r_data = (ctypes.c_uint8 * 4)()
+    lib_blob.ring_buf_write(ctypes.pointer(ring), ctypes.c_char_p(b"\x01\x02\x03"), 3)
+    lib_blob.ring_buf_read(ctypes.pointer(ring), r_data, 3)
+    for c in range(4, 8):
+        assert lib_blob.ring_buf_write_byte(ctypes.pointer(ring), c), f"Byte {c} should fit"
+    assert not lib_blob.ring_buf_write_byte(ctypes.pointer(ring), 8), "Full ring should refuse a byte"
+    to_read = lib_blob.ring_buf_read(ctypes.pointer(ring), r_data, 4)
+    assert bytes(r_data[:to_read]) == b"\x04\x05\x06\x07", f"Wrong data across wrap ({bytes(r_data[:to_read])})"
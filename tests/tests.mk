@@ -8,7 +8,7 @@ $$($(1)_OBJECTS): $$(BUILD_TESTS_DIR)/%.o: %.c $$(BUILD_DIR)/.git.$$(GIT_COMMIT)
 	mkdir -p $$(@D)
 	echo $(addprefix $(BUILD_TESTS_DIR)/.,$(TESTS))
 	# Using gcc instead of $(CC) as we want to use this object natively
-	gcc -c -I$$(INCLUDE_DIR) $$< -o $$@
+	gcc -c $$(TEST_CFLAGS) -I$$(INCLUDE_DIR) $$< -o $$@
 
 $$(BUILD_TESTS_DIR)/$(1).so: $$($(1)_OBJECTS)
 	mkdir -p $$(@D)
@@ -20,12 +20,23 @@ $$(BUILD_TESTS_DIR)/.$(1): $$(BUILD_TESTS_DIR)/$(1).so
 	touch $$@
 endef
 
-TESTS := ring_buf crc cobs
+TESTS := ring_buf crc cobs fw_update clocks_calc events itf
 
 # Not using foreach as test might require multiple sources/different names
 $(eval $(call TEST_OBJ_BUILD_RULE,ring_buf,$(SOURCE_DIR)/ring_buf.c))
 $(eval $(call TEST_OBJ_BUILD_RULE,crc,$(SOURCE_DIR)/crc.c))
 $(eval $(call TEST_OBJ_BUILD_RULE,cobs,libs/nanocobs/cobs.c))
+$(eval $(call TEST_OBJ_BUILD_RULE,fw_update,$(SOURCE_DIR)/fw_update.c tests/flash_sim.c))
+# fw_update needs crc, reuse its objects rather than a second rule for them
+$(BUILD_TESTS_DIR)/fw_update.so: $(crc_OBJECTS)
+$(eval $(call TEST_OBJ_BUILD_RULE,clocks_calc,$(SOURCE_DIR)/clocks_calc.c))
+$(eval $(call TEST_OBJ_BUILD_RULE,events,$(SOURCE_DIR)/events.c tests/events_stubs.c))
+# events.c masks interrupts through libopencm3, use the host stand-in
+$(events_OBJECTS): TEST_CFLAGS := -Itests/stubs
+# itf builds and checks frames with the real crc and nanocobs
+$(eval $(call TEST_OBJ_BUILD_RULE,itf,$(SOURCE_DIR)/itf.c tests/itf_stubs.c))
+$(BUILD_TESTS_DIR)/itf.so: $(crc_OBJECTS) $(cobs_OBJECTS)
+$(itf_OBJECTS): TEST_CFLAGS := -Ilibs/nanocobs
 
 $(BUILD_TESTS_DIR)/.complete: $(addprefix $(BUILD_TESTS_DIR)/.,$(TESTS))
 	pytest --cov=pyeese --rootdir=$(BUILD_TESTS_DIR) -v tests/